@@ -5,6 +5,9 @@
 /***  MODIFIED: 9/93 - Trent Whiteley                            ***/
 /***                   Changed basis_coef from array to ptr      ***/
 /***  PUBLIC ROUTINES:                                           ***/
+/***      void ClearAE()                                         ***/
+/***      void SetOutsideAE()                                    ***/
+/***      void TermsAE()                                         ***/
 /***      int *CreateAE()                                        ***/
 /***      int InitAE()                                           ***/
 /***      int DestroyAE()                                        ***/
@@ -19,52 +22,138 @@
 /***      int AssignRight()                                      ***/
 /***      int PrintAE()                                          ***/
 /***  PRIVATE ROUTINES:                                          ***/
-/***      int LeftTapAE()                                        ***/
+/***      void MakeSparseAE()                                    ***/
+/***      void ZeroDenseAE()                                     ***/
 /***      int CopyAE()                                           ***/
 /***  MODULE DESCRIPTION:                                        ***/
 /***      This module contains routines dealing with Algebraic   ***/
 /***      elements.                                              ***/
 /*******************************************************************/
 
+#include <algorithm>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "Alg_elements.h"
+#include "Basis_table.h"
 #include "Build_defs.h"
 #include "Memory_routines.h"
 #include "Mult_table.h"
 #include "Scalar_arithmetic.h"
+#include "Type_table.h"
+
+using std::vector;
+using std::pair;
+using std::make_pair;
 
-using std::map;
+static thread_local Product_acc Mult_acc;     /* Scratch of MultAE(), per thread. */
 
-static void clearZeros(Alg_element &p2);
-static int LeftTapAE(Scalar x, Basis b, const Alg_element &p1, Alg_element &p2);
+static void MakeSparseAE(Alg_element &p);
+static void ZeroDenseAE(Alg_element &p);
 #if 1
 void PrintAE(const Alg_element &p);
 #endif
 
-static void clearZeros(Alg_element &p) {
-#if 0
-    int ne = p.size();
-    int nz = 0;
-#endif
-    map<Basis, Scalar>::iterator i;
-    for(i = p.begin(); i != p.end();) {
-      if(i->first == 0 || i->second == 0) {
-        p.erase(i++);
-#if 0
-        nz++;
-#endif
-      } else {
-        i++;
-      } 
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     p -- left with no terms.  Only the entries of its dense     */
+/*          array that were set are zeroed; the array keeps its    */
+/*          size for the next type it is given.                    */
+/*******************************************************************/
+void ClearAE(Alg_element &p)
+{
+    ZeroDenseAE(p);
+    p.type = EMPTY_AE;
+    p.first = 0;
+    p.sparse.clear();
+}
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     p -- every entry of its dense array zero.                   */
+/*******************************************************************/
+void ZeroDenseAE(Alg_element &p)
+{
+    if (p.lo < p.hi)
+        std::fill(p.dense.begin() + p.lo, p.dense.begin() + p.hi, S_zero());
+    p.lo = 0;
+    p.hi = 0;
+}
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     p -- a dense element moved to the sparse map, MIXED_AE.     */
+/*******************************************************************/
+void MakeSparseAE(Alg_element &p)
+{
+    if (p.type >= 0) {
+        for (int i=p.lo; i<p.hi; i++)
+            if (p.dense[i] != S_zero())
+                p.sparse[p.first + i] = p.dense[i];
+        ZeroDenseAE(p);
+    }
+    p.type = MIXED_AE;
+}
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     p -- coefficient of b set to x.                             */
+/* REQUIRES:                                                       */
+/*     b -- outside the dense range of p, if it has one.           */
+/* FUNCTION:                                                       */
+/*     An empty element takes the type of b, its zeroed dense      */
+/*     array resized to the range of the type; an element of      */
+/*     another type becomes sparse.                                */
+/*******************************************************************/
+void SetOutsideAE(Alg_element &p, Basis b, Scalar x)
+{
+    if (b == 0)
+        return;
+
+    if (p.type == EMPTY_AE) {
+        if (x == S_zero())
+            return;
+        const Name n = GetType(b);
+        p.type = n;
+        p.first = BeginBasis(n);
+        p.dense.resize(EndBasis(n) - BeginBasis(n) + 1, S_zero());
+        TouchAE(p, b - p.first);
+        p.dense[b - p.first] = x;
+        return;
+    }
+
+    if (p.type != MIXED_AE) {
+        if (x == S_zero())
+            return;
+        MakeSparseAE(p);
+    }
+
+    if (x != S_zero())
+        p.sparse[b] = x;
+    else
+        p.sparse.erase(b);
+}
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Terms -- the nonzero terms of p, in ascending basis.        */
+/*******************************************************************/
+void TermsAE(const Alg_element &p, vector<pair<Basis, Scalar> > &Terms)
+{
+    Terms.clear();
+
+    if (p.type >= 0) {
+        for (int i=p.lo; i<p.hi; i++)
+            if (p.dense[i] != S_zero())
+                Terms.push_back(make_pair(p.first + i, p.dense[i]));
+    } else {
+        Sparse_terms::const_iterator i;
+        for(i = p.sparse.begin(); i != p.sparse.end(); i++)
+            if (i->second != S_zero())
+                Terms.push_back(*i);
     }
-#if 0
-  if(nz > 0) {
-      printf("%d of %d zero coef or basis terms removed\n", nz, ne);
-  }
-#endif
 }
 
 /*******************************************************************/
@@ -77,9 +166,14 @@ static void clearZeros(Alg_element &p) {
 /*******************************************************************/ 
 int IsZeroAE(const Alg_element &p)
 {
-    map<Basis, Scalar>::const_iterator i;
-    for(i = p.begin(); i != p.end(); i++) {
-      if(i->first != 0 && i->second != 0) return 0;
+    if (p.type >= 0) {
+      for (int i=p.lo; i<p.hi; i++)
+        if (p.dense[i] != S_zero()) return 0;
+    } else {
+      Sparse_terms::const_iterator i;
+      for(i = p.sparse.begin(); i != p.sparse.end(); i++) {
+        if(i->first != 0 && i->second != 0) return 0;
+      }
     }
 
   return 1;
@@ -101,15 +195,16 @@ void ScalarMultAE(Scalar x, Alg_element &p)
 {
     if (x == S_one()) {
     } else if (x == S_zero()) {
-        p.clear();
+        ClearAE(p);
+    } else if (p.type >= 0) {
+      for (int i=p.lo; i<p.hi; i++)
+        p.dense[i] = S_mul(x, p.dense[i]);
     } else {
-      map<Basis, Scalar>::iterator i;
-      for(i = p.begin(); i != p.end(); i++) {
+      Sparse_terms::iterator i;
+      for(i = p.sparse.begin(); i != p.sparse.end(); i++) {
         i->second = S_mul(x, i->second);
       }
     }
-
-    clearZeros(p);
 }
 
 /*******************************************************************/
@@ -124,76 +219,34 @@ void ScalarMultAE(Scalar x, Alg_element &p)
 /*     Add Alg_element *p1 to *p2.                                 */ 
 /*     *p2 = *p2 + *p1.                                            */
 /* NOTE:                                                           */
-/*     We have to scan p2 to find and store p2->first.             */
+/*     Elements of the same type are added entry by entry.         */
 /*******************************************************************/ 
 void AddAE(const Alg_element &p1, Alg_element &p2)
 {
-      map<Basis, Scalar>::const_iterator p1i = p1.begin();
-      map<Basis, Scalar>::iterator p2i = p2.begin();
-      
-    while(p1i != p1.end()) {
-      if(p2i == p2.end()) {  /* occurs if max_basis(p2) < max_basis(p1) */
-        p2[p1i->first] = p1i->second;
-
-        p1i++;
-#if 0
-      } else if(p2i->first == 0) {
-        p2i->first = p1i->first;
-        p2i->second = p1i->second;
-
-        p1i++;
-        p2i++;
-#endif
-      } else if(p2i->first == p1i->first) {
-        p2i->second = S_add(p2i->second, p1i->second);
-
-        p1i++;
-        p2i++;
-      } else if(p2i->first < p1i->first) {
-        p2i++;
-      } else if(p2i->first > p1i->first) {
-        p2[p1i->first] = p1i->second;
+    if (p1.type == EMPTY_AE)
+        return;
 
-        p1i++;
-      }
+    if (p2.type == EMPTY_AE && p1.type >= 0) {
+        p2.type = p1.type;
+        p2.first = p1.first;
+        p2.dense.resize(p1.dense.size(), S_zero());
     }
 
-    clearZeros(p2);
-}    
-
-/*******************************************************************/
-/* MODIFIES:                                                       */
-/*     *p2 -- Alg_element.                                         */ 
-/* REQUIRES:                                                       */
-/*     x -- Coefficient of the term.                               */
-/*     b -- Basis of the term.                                     */ 
-/*     *p1 -- Alg_element used for multiplication.                 */
-/* RETURNS:                                                        */
-/*     1 if successfull.                                           */
-/*     0 otherwise.                                                */
-/* FUNCTION:                                                       */
-/*     Multiply term with Alg_element *p1 and add to *p2.          */
-/*         *p2 = xb.(*p1) + *p2                                    */
-/*******************************************************************/ 
-int LeftTapAE(Scalar x, Basis b, const Alg_element &p1, Alg_element &p2)
-{
-    int status = OK;
-
-    const Scalar zero = S_zero();
-    if (x != zero && !IsZeroAE(p1)) {
-      map<Basis, Scalar>::const_iterator i;
-      for(i = p1.begin(); i != p1.end(); i++) {
-        if(i->second != zero) {
-                if (status == OK)
-                    status = Mult2basis(b, i->first, S_mul(x, i->second), p2); 
-            }
-      }
+    if (p1.type >= 0 && p1.type == p2.type) {
+        if (p1.lo < p1.hi) {
+            TouchAE(p2, p1.lo);
+            TouchAE(p2, p1.hi - 1);
+        }
+        for (int i=p1.lo; i<p1.hi; i++)
+            p2.dense[i] = S_add(p2.dense[i], p1.dense[i]);
+    } else {
+        vector<pair<Basis, Scalar> > terms;
+        TermsAE(p1, terms);
+        for (int i=0; i<(int)terms.size(); i++)
+            AccumAE(p2, terms[i].first, terms[i].second);
     }
-    clearZeros(p2);
+}    
 
-        return(status);
-}
-    
 /*******************************************************************/
 /* MODIFIES:                                                       */
 /*     *p3 -- Alg_element.                                         */ 
@@ -205,24 +258,24 @@ int LeftTapAE(Scalar x, Basis b, const Alg_element &p1, Alg_element &p2)
 /* FUNCTION:                                                       */
 /*     Multiply Alg_elements *p1,*p2 and add to *p3.               */
 /*         *p3 = (*p1) * (*p2) + *p3                               */ 
+/* NOTE:                                                           */
+/*     The products are summed unreduced in Mult_acc and reduced   */
+/*     once at the end.  Each thread has its own Mult_acc.         */
 /*******************************************************************/ 
 int MultAE(const Alg_element &p1, const Alg_element &p2, Alg_element &p3)
 {
-    int status = OK;
-
-    const Scalar zero = S_zero();
-    if (!IsZeroAE(p1) && !IsZeroAE(p2)) {
-      map<Basis, Scalar>::const_iterator p1i;
-      for(p1i = p1.begin(); p1i != p1.end(); p1i++) {
-        if(p1i->second != zero) {
-                if (status == OK)
-                    status = LeftTapAE(p1i->second, p1i->first, p2, p3); 
-            }
-        }
-    }
-    clearZeros(p3);
+    vector<pair<Basis, Scalar> > terms1, terms2;
+    TermsAE(p1, terms1);
+    TermsAE(p2, terms2);
+
+    PrepareProductAcc(Mult_acc);
+    const bool found = MultTerms(terms1, terms2, Mult_acc);
+    CollectProducts(Mult_acc, terms1);
+
+    for (int i=0; i<(int)terms1.size(); i++)
+        AccumAE(p3, terms1[i].first, terms1[i].second);
 
-    return(status);
+    return(found ? OK : 0);
 }
 
 #if 0
@@ -238,8 +291,10 @@ int MultAE(const Alg_element &p1, const Alg_element &p2, Alg_element &p3)
 /*******************************************************************/ 
 void PrintAE(const Alg_element &p)
 {
-    map<Basis, Scalar>::const_iterator pi;
-    for(pi = p.begin(); pi != p.end(); pi++) {
+    vector<pair<Basis, Scalar> > terms;
+    TermsAE(p, terms);
+    vector<pair<Basis, Scalar> >::const_iterator pi;
+    for(pi = terms.begin(); pi != terms.end(); pi++) {
          Basis basis = pi->first;
          Scalar coef = pi->second;
          if(coef != 0) {
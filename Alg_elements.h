@@ -9,44 +9,90 @@
 /*******************************************************************/
 
 #include <map>
+#include <vector>
+#include <utility>
 
 #include "Build_defs.h"
+#include "Memory_routines.h"
 #include "Scalar_arithmetic.h"
 
-typedef std::map<Basis, Scalar> Alg_element; // basis -> coef
+#define EMPTY_AE  -1    /* Alg_element::type of an element with no terms yet. */
+#define MIXED_AE  -2    /* Alg_element::type of an element of several types. */
 
+/*
+ * An element of the algebra.  The elements met in practice are
+ * homogeneous: all their basis elements have one type, and the basis
+ * elements of a type are numbered consecutively.  Such an element holds
+ * a dense array of coefficients over the range of its type.  A term of
+ * a second type moves the element to a sparse map, basis -> coef.
+ * Only entries lo .. hi-1 of the array may be nonzero, so clearing an
+ * element and running over its terms cost what its terms span, not
+ * the whole range of its type.
+ */
+typedef std::map<Basis, Scalar, std::less<Basis>, Pool_allocator<std::pair<const Basis, Scalar> > > Sparse_terms;
+
+struct Alg_element {
+    Alg_element() : type(EMPTY_AE), first(0), dense(), lo(0), hi(0), sparse() {}
+
+    Name type;                          /* The type, EMPTY_AE or MIXED_AE. */
+    Basis first;                        /* Basis of dense[0]. */
+    std::vector<Scalar> dense;          /* Coefficients of the type's range. */
+    int lo;                             /* Entries of dense that may be */
+    int hi;                             /* nonzero: lo .. hi-1. */
+    Sparse_terms sparse;                /* Terms of a MIXED_AE element. */
+};
+
+void ClearAE(Alg_element &p);
 int IsZeroAE(const Alg_element &p);
 void ScalarMultAE(Scalar x, Alg_element &p);
 void AddAE(const Alg_element &p1, Alg_element &p2);
 int MultAE(const Alg_element &p1, const Alg_element &p2, Alg_element &p3);
+void TermsAE(const Alg_element &p, std::vector<std::pair<Basis, Scalar> > &Terms);
+void SetOutsideAE(Alg_element &p, Basis b, Scalar x);
+
+inline bool InRangeAE(const Alg_element &p, Basis b) {
+  return p.type >= 0 && b >= p.first && b < p.first + (Basis) p.dense.size();
+}
+
+/* Entry I of the dense array of p is about to be set. */
+inline void TouchAE(Alg_element &p, int i) {
+  if(p.lo >= p.hi) {
+    p.lo = i;
+    p.hi = i + 1;
+  } else if(i < p.lo) {
+    p.lo = i;
+  } else if(i >= p.hi) {
+    p.hi = i + 1;
+  }
+}
 
 inline void SetAE(Alg_element &p, Basis b, Scalar x) {
-  if(x != S_zero()) {
-    p[b] = x;
+  if(InRangeAE(p, b)) {
+    TouchAE(p, b - p.first);
+    p.dense[b - p.first] = x;
   } else {
-    p.erase(b);
+    SetOutsideAE(p, b, x);
   }
 }
 
 inline Scalar GetAE(const Alg_element &p, Basis b) {
-  std::map<Basis, Scalar>::const_iterator i = p.find(b);
+  if(InRangeAE(p, b))
+    return p.dense[b - p.first];
+  if(p.type != MIXED_AE)
+    return S_zero();
+
+  Sparse_terms::const_iterator i = p.sparse.find(b);
 
-  return i != p.end() ? i->second : S_zero();
+  return i != p.sparse.end() ? i->second : S_zero();
 }
 
 inline void AccumAE(Alg_element &p, Basis b, Scalar x) {
   if(b != 0 && x != S_zero()) {
-    std::map<Basis, Scalar>::iterator i = p.find(b);
-
-    if(i != p.end()) {
-      x = S_add(i->second, x);
-      if(x != S_zero()) {
-        i->second = x;
-      } else {
-        p.erase(i);
-      }
+    if(InRangeAE(p, b)) {
+      TouchAE(p, b - p.first);
+      p.dense[b - p.first] = S_add(p.dense[b - p.first], x);
     } else {
-      p[b] = x;
+      SetOutsideAE(p, b, S_add(GetAE(p, b), x));
     }
   }
 }
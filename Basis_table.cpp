@@ -11,6 +11,8 @@
 /***      int GetNextbasistobefilled()                           ***/
 /***      Basis LeftFactor()                                     ***/
 /***      Basis RightFactor()                                    ***/
+/***      void IndexBasisFactors()                               ***/
+/***      Basis FactorBasis()                                    ***/
 /***      int Getdeg()                                           ***/
 /***      Type  GetType()                                        ***/
 /***  PRIVATE ROUTINES:                                          ***/
@@ -18,6 +20,7 @@
 /***      This module contains routines dealing with Basis Table.***/
 /*******************************************************************/
 
+#include <algorithm>
 #include <vector>
 
 using std::vector;
@@ -46,6 +49,15 @@ typedef struct {
 
 static vector<BT_rec> Basis_table;
 static vector<pair<Basis, Basis> > Deg_to_basis_table; // maps degree to first and last indices in Basis_table associated with that degree
+static vector<Basis> Factor_order;  /* The basis elements of each type, by ascending factors. */
+
+struct Factor_less {
+    bool operator()(Basis A, Basis B) const {
+        if (Basis_table[A].left_factor != Basis_table[B].left_factor)
+            return Basis_table[A].left_factor < Basis_table[B].left_factor;
+        return Basis_table[A].right_factor < Basis_table[B].right_factor;
+    }
+};
 
 /*******************************************************************/
 /* GLOBALS INITIALIZED:                                            */
@@ -71,6 +83,7 @@ int CreateBasisTable()
     }
 
     Deg_to_basis_table.clear();
+    Factor_order.assign(1, 0);
 
     return(OK);
 }
@@ -152,6 +165,76 @@ Name GetType(Basis B)
 }
 
 
+/*******************************************************************/
+/* MODIFIES: None.                                                 */
+/* REQUIRES:                                                       */
+/*     B -- Basis element.                                         */
+/* RETURNS:                                                        */
+/*     Left and right factors of the Basis B, 0 for a generator.   */
+/*******************************************************************/ 
+Basis LeftFactor(Basis B)
+{
+    return(Basis_table[B].left_factor);
+}
+
+
+Basis RightFactor(Basis B)
+{
+    return(Basis_table[B].right_factor);
+}
+
+
+/*******************************************************************/
+/* GLOBALS MODIFIED:                                               */
+/*     Factor_order -- takes the basis elements entered since the  */
+/*                     last call, each type's by their factors.    */
+/* REQUIRES:                                                       */
+/*     Every basis element of a type entered by the same call.     */
+/*******************************************************************/ 
+void IndexBasisFactors(void)
+{
+    Basis b = Factor_order.size();
+    while (b < (Basis) Basis_table.size()) {
+        Basis e = b + 1;
+        while (e < (Basis) Basis_table.size() && Basis_table[e].type == Basis_table[b].type)
+            e++;
+        for (Basis k = b; k < e; k++)
+            Factor_order.push_back(k);
+        std::sort(Factor_order.begin() + b, Factor_order.begin() + e, Factor_less());
+        b = e;
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES: None.                                                 */
+/* REQUIRES:                                                       */
+/*     Begin .. End -- the basis range of a type, indexed.         */
+/* RETURNS:                                                        */
+/*     The basis element of that range with factors Left_factor   */
+/*     and Right_factor, 0 if there is none.                       */
+/*******************************************************************/ 
+Basis FactorBasis(Basis Left_factor, Basis Right_factor, Basis Begin, Basis End)
+{
+    Basis lo = Begin;
+    Basis hi = End + 1;
+    while (lo < hi) {
+        const Basis mid = lo + (hi - lo) / 2;
+        const BT_rec &br = Basis_table[Factor_order[mid]];
+        if (br.left_factor < Left_factor ||
+            (br.left_factor == Left_factor && br.right_factor < Right_factor))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > End)
+        return 0;
+
+    const Basis b = Factor_order[lo];
+    return (Basis_table[b].left_factor == Left_factor && Basis_table[b].right_factor == Right_factor) ? b : 0;
+}
+
+
 /*******************************************************************/
 /* MODIFIES: None.                                                 */
 /* REQUIRES:                                                       */
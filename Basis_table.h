@@ -19,6 +19,10 @@ Basis GetNextBasisTobeFilled(void);
 Basis BasisStart(Degree Deg);
 Basis BasisEnd(Degree Deg);
 Name GetType(Basis B);
+Basis LeftFactor(Basis B);
+Basis RightFactor(Basis B);
+void IndexBasisFactors(void);
+Basis FactorBasis(Basis Left_factor, Basis Right_factor, Basis Begin, Basis End);
 void PrintBasisTable(FILE *filePtr);
 
 #endif
@@ -15,8 +15,11 @@
 /***      int DestroyStructures()                               ***/ 
 /***      int PrintProgress()                                   ***/
 /***      int ProcessDegree()                                   ***/
+/***      int ProcessTypesConcurrently()                        ***/
 /***      int ProcessType()                                     ***/
 /***      int SolveEquations()                                  ***/
+/***      int ExtractType()                                     ***/
+/***      int CommitType()                                      ***/
 /***  MODULE DESCRIPTION:                                       ***/
 /***      Implement the Build Command.                          ***/
 /***      Reads the sparse global variable to determine         ***/
@@ -24,36 +27,83 @@
 /***      in the SolveEquations routine.                        ***/
 /******************************************************************/
 
+#include <algorithm>
 #include <list>
 #include <vector>
 
 using std::list;
+using std::stable_sort;
 using std::vector;
 
 #include <stdio.h>
 #include <time.h>
 
+#include <omp.h>
+
 #include "Build.h"
+#include "Build_cache.h"
 #include "Build_defs.h"
 #include "Basis_table.h"
 #include "ExtractMatrix.h"
 #include "GenerateEquations.h"
 #include "Mult_table.h"
+#include "Multpart.h"
 #include "CreateMatrix.h"
 #include "Po_parse_exptext.h"
+#include "Id_dag.h"
 #include "Id_routines.h"
+#include "Memory_routines.h"
+#include "PerformSub.h"
 #include "SparseReduceMatrix.h"
+#include "Type_table.h"
 #include "Debug.h"
 
+/*
+ * One type of the degree being processed: its matrix, and what the
+ * reduced matrix adds to the Basis and Mult tables once extracted.
+ */
+struct Type_work {
+    Type_work() : n(0), cost(0), SM(), cols(0), rank(0), BPtoCol(), neqn(0), nterms(0), peak_mb(0),
+        dropped(0), pruned_subs(0), pruned_perms(0), memo_hits(0), memo_lookups(0), memo_saved(0),
+        rows(0), fill(), matrix_mb(), extraction(), status(OK) {}
+
+    Name n;
+    long cost;                  /* Basis pairs of the type; estimates the work. */
+    SparseMatrix SM;
+    int cols;
+    int rank;
+    vector<Unique_basis_pair> BPtoCol;
+    long neqn;
+    long nterms;
+    double peak_mb;             /* Most equations held at once before becoming matrix rows. */
+    long dropped;               /* Rows dropped by online reduction. */
+    long pruned_subs;           /* Equations not generated as duplicates. */
+    long pruned_perms;          /* Permutations not expanded as duplicates. */
+    long memo_hits;             /* Of the memo of MUL results. */
+    long memo_lookups;
+    double memo_saved;          /* Seconds the hits saved. */
+    int rows;                   /* Of the matrix, before reduction. */
+    double fill[2];             /* Percent of the matrix nonzero, before and after reduction. */
+    double matrix_mb[2];
+    Extraction extraction;
+    int status;
+};
+
 static int InitializeStructures(Type Target_type);
 static long ElapsedTime(void);
 static void PrintProgress(int i, int n);
-static int ProcessDegree(int i, const list<id_queue_node> &First_id_node);
+static int ProcessDegree(int i, const vector<Identity_dag> &Identities);
+static int ProcessTypesConcurrently(int i, const vector<Identity_dag> &Identities);
 static void InstallDegree1(void);
-static int ProcessType(Name n, const list<id_queue_node> &First_id_node, SparseMatrix &SM);
-static int SolveEquations(SparseMatrix &SM, int cols, vector<Unique_basis_pair> &BPtoCol, Name n);
+static int ProcessType(Type_work &W, const vector<Identity_dag> &Identities, bool Verbose);
+static int SolveEquations(Type_work &W, bool Verbose);
+static int ExtractType(Type_work &W);
+static int CommitType(Type_work &W, bool Verbose);
+static bool GreaterCost(const Type_work *W1, const Type_work *W2);
 
 extern int sigIntFlag;		/* TW 10/8/93 - flag for Ctrl-C */
+extern int Online_reduction;
+extern int Concurrent_types;
 
 static time_t Start_time; 
 static Basis Current_dimension;
@@ -83,19 +133,51 @@ int Build(list<id_queue_node> &Idq_node, Type Target_type)
 
     status = InitializeStructures(Target_type);
 
-    int Target_degree = GetDegreeName(TypeToName(Target_type));
+    /* Identities are compiled once; their polynomials outlive the build. */
+    vector<Identity_dag> Identities;
+    for (list<id_queue_node>::const_iterator ii = Idq_node.begin(); ii != Idq_node.end(); ii++)
+        Identities.push_back(Identity_dag(ii->identity));
+
+    long allocs0, pooled0;
+    double live_mb, slab_mb;
+    GetPoolStats(&allocs0, &pooled0, &live_mb, &slab_mb);
+
+    int Target_degree = GetDegreeName(TypeToName(PackType(Target_type, GetTargetLen())));
+    int Cached_degree = 0;
+    if (status == OK && (Cached_degree = CacheLookup(Idq_node, Target_degree)) > 0) {
+        Current_dimension = GetNextBasisTobeFilled() - 1;
+        printf("Degrees 1-%d loaded from the build cache.\n", Cached_degree);
+        PrintProgress(Cached_degree, Target_degree);
+    }
     if (status == OK) {
-        for (int i=1; i <= Target_degree; i++)  {
-            status = ProcessDegree(i, Idq_node);
+        for (int i=Cached_degree+1; i <= Target_degree; i++)  {
+            status = ProcessDegree(i, Identities);
 	    if(sigIntFlag == 1){
 /*	      printf("Returning from Build().\n");*/
 	      return(-1);
 	    }
             if (status != OK) 
                 break;
+            CheckPools();
+            TrimPools();
             PrintProgress(i, Target_degree);
+            if (i > 1)
+                CacheStore(Idq_node, i);
         }
     }
+    ResetEnumerationCache();
+
+    long allocs, pooled;
+    GetPoolStats(&allocs, &pooled, &live_mb, &slab_mb);
+    long products, implicit, terms;
+    double bytes, map_bytes;
+    CompactMultTable();
+    GetMultTableStats(&products, &implicit, &terms, &bytes, &map_bytes);
+    printf("Mult table: %ld products (implicit: %ld), %ld terms, bytes/product: %.1f (as map: %.1f)\n",
+           products, implicit, terms, bytes, map_bytes);
+    printf("Allocations: %ld (pooled: %ld, slabs peak MB: %.2f%s)\n",
+           allocs - allocs0, pooled - pooled0, slab_mb, System_allocator ? ", system allocator" : "");
+
 #if PRINT_BASIS_TABLE
     PrintBasisTable();
 #endif
@@ -162,17 +244,15 @@ void PrintProgress(int i, int n)
 /* FUNCTION:                                                       */
 /*     Process all Types of degree i.                              */
 /*******************************************************************/
-int ProcessDegree(int i, const list<id_queue_node> &First_id_node)
+int ProcessDegree(int i, const vector<Identity_dag> &Identities)
 {
    Name n;
    int status = OK;
-   Basis begin_basis;
-   Basis end_basis = 0;
-
-SparseMatrix SM;
 
    if (i == 1)
        InstallDegree1();
+   else if (Concurrent_types)
+       status = ProcessTypesConcurrently(i, Identities);
    else {
        int nn1 = 0;
        int nn2 = 0;
@@ -184,28 +264,116 @@ SparseMatrix SM;
          }
        }
 
+       Type_work w;
        n = FirstTypeDegree(i);
        while ((status == OK) && (n != -1)) {
-           begin_basis = GetNextBasisTobeFilled();
-           printf("\tProcessing(%2d/%2d, begin_basis:%d)...", ++nn1, nn2, begin_basis); fflush(NULL);
-           status = ProcessType(n, First_id_node, SM);
+           w.n = n;
+           w.extraction.first_basis = GetNextBasisTobeFilled();
+           printf("\tProcessing(%2d/%2d, begin_basis:%d)...", ++nn1, nn2, w.extraction.first_basis); fflush(NULL);
+           ResetSubMemo();
+           ResetEnumerationCache();
+           status = ProcessType(w, Identities, true);
 	   if(sigIntFlag == 1){	/* TW 10/5/93 - Ctrl-C check */
 /*	     printf("Returning from ProcessDegree().\n");*/
 	     return(-1);
 	   }
-           end_basis = GetNextBasisTobeFilled() - 1;
-           if (end_basis < begin_basis)
-               UpdateTypeTable(n,0,0);    /* No Basis table entries. */
-           else
-               UpdateTypeTable(n,begin_basis,end_basis);
+           if (status == OK)
+               status = ExtractType(w);
+           if (status == OK)
+               status = CommitType(w, false);
+           printf("(%lds)\n", ElapsedTime());
            n = NextTypeSameDegree(n);
        }
-       Current_dimension = end_basis;
    }
+
+   Current_dimension = GetNextBasisTobeFilled() - 1;
+
    return(status);
 }
 
 
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     i -- to process degree i, i > 1.                            */
+/* FUNCTION:                                                       */
+/*     Process all Types of degree i at once.  A type's equations  */
+/*     only involve basis elements of lower degree, so the types   */
+/*     are generated, solved and extracted side by side, largest   */
+/*     first, each by one thread.  The number of new basis         */
+/*     elements of a type is its number of basis pairs less its    */
+/*     rank, which fixes where each type's basis numbers begin     */
+/*     before any is extracted.  The results are then committed in */
+/*     type order, giving the same tables as ProcessDegree() does  */
+/*     one type at a time.                                         */
+/*******************************************************************/
+int ProcessTypesConcurrently(int i, const vector<Identity_dag> &Identities)
+{
+    vector<Type_work> work;
+    for (Name n = FirstTypeDegree(i); n != -1; n = NextTypeSameDegree(n)) {
+        work.push_back(Type_work());
+        work.back().n = n;
+        work.back().cost = CountBasisPairs(n);
+    }
+
+    vector<Type_work *> order;
+    for (int k=0; k<(int)work.size(); k++)
+        order.push_back(&work[k]);
+    stable_sort(order.begin(), order.end(), GreaterCost);
+
+    printf("\tProcessing %d types...", (int)work.size()); fflush(NULL);
+    ResetSubMemo();
+    ResetEnumerationCache();
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int k=0; k<(int)order.size(); k++) {
+        if (sigIntFlag == 1)
+            continue;
+        order[k]->status = ProcessType(*order[k], Identities, false);
+    }
+
+    if(sigIntFlag == 1){	/* TW 10/5/93 - Ctrl-C check */
+      return(-1);
+    }
+
+    Basis next_basis = GetNextBasisTobeFilled();
+    for (int k=0; k<(int)work.size(); k++) {
+        if (work[k].status != OK)
+            return(work[k].status);
+        work[k].extraction.first_basis = next_basis;
+        next_basis += work[k].cost - work[k].rank;
+    }
+
+    long hits, lookups;
+    double mb;
+    GetEnumerationCacheStats(&hits, &lookups, &mb);
+    printf("enum:%ld/%ld (MB:%.2f)...(%lds)...Extracting...", hits, lookups, mb, ElapsedTime()); fflush(NULL);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int k=0; k<(int)order.size(); k++)
+        order[k]->status = ExtractType(*order[k]);
+
+    printf("(%lds)\n", ElapsedTime());
+
+    int status = OK;
+    for (int k=0; k<(int)work.size() && status == OK; k++) {
+        Type_work &w = work[k];
+        printf("\tProcessed(%2d/%2d, begin_basis:%d) neqn:%ld pruned:%ld (perms:%ld) cols:%d rank:%d\n",
+               k+1, (int)work.size(), w.extraction.first_basis, w.neqn, w.pruned_subs, w.pruned_perms, w.cols, w.rank);
+        status = w.status;
+        if (status == OK)
+            status = CommitType(w, true);
+    }
+
+    return(status);
+}
+
+
+bool GreaterCost(const Type_work *W1, const Type_work *W2)
+{
+    return W1->cost > W2->cost;
+}
+
+
 /*******************************************************************/
 /* REQUIRES: None.                                                 */
 /* FUNCTION:                                                       */
@@ -216,14 +384,11 @@ void InstallDegree1(void)
 {
     Basis end_basis = 0;
 
-    Type temp_type = GetNewType();
-    
     int len = GetTargetLen();
 
     for (int i=0;i<len;i++) {
-        for (int j=0;j<len;j++)
-            temp_type[j] = 0;
-        temp_type[i] = 1;
+        Packed_type temp_type = ZeroType();
+        SetLetter(temp_type, i, 1);
         Name n = TypeToName(temp_type);
         Basis begin_basis = GetNextBasisTobeFilled();
         EnterBasis(0,0,n);
@@ -231,94 +396,133 @@ void InstallDegree1(void)
         UpdateTypeTable(n,begin_basis,end_basis);
     }
     Current_dimension = end_basis;
-
-    free(temp_type);
 }
 
 
 /*******************************************************************/
+/* MODIFIES:                                                       */
+/*     W -- SM holds the reduced matrix of type W.n, with its      */
+/*          columns, rank and BPtoCol.                             */
 /* REQUIRES:                                                       */
-/*     t -- to process Type t.                                     */ 
+/*     Verbose -- print progress.                                  */
 /* FUNCTION:                                                       */
 /*     For each identity f, whose degree is less than the degree   */
 /*     of type t, generate equations corresponding to f.           */
-/*     Then solve those equations, to get New Baisis and write     */
-/*     other basis pairs in terms of existing basis.               */ 
+/*     Then solve those equations; ExtractType() then gets the     */
+/*     New Basis and writes other basis pairs in terms of them.    */
 /*******************************************************************/
 /* Process type t for degree i */
-int ProcessType(Name n, const list<id_queue_node> &First_id_node, SparseMatrix &SM)
+int ProcessType(Type_work &W, const vector<Identity_dag> &Identities, bool Verbose)
 {
-  int cols = 0;
-  vector<Unique_basis_pair> BPtoCol;
-
+  const Name n = W.n;
+  SparseMatrix &SM = W.SM;
+
+  W.cols = 0;
+  W.rank = 0;
+  W.pruned_subs = 0;
+  W.pruned_perms = 0;
+  W.BPtoCol.clear();
   SM.clear();
 
   int status = OK;
   {
-    Equations equations;
+    Matrix_builder builder(n, SM);
 
-    printf("Generating..."); fflush(NULL);
-
-    list<id_queue_node>::const_iterator ii = First_id_node.begin();
-    for(; ii != First_id_node.end() && status == OK; ii++) {
-        const polynomial *f = ii->identity;
+    if (Verbose) {
+      printf("Generating..."); fflush(NULL);
+    }
 
-        if(f->degree <= GetDegreeName(n)) {
-            status = GenerateEquations(f, n, equations);
+    vector<const Identity_dag *> active;
+    for (int i=0; i<(int)Identities.size(); i++)
+        if (Identities[i].Degree() <= GetDegreeName(n))
+            active.push_back(&Identities[i]);
+
+    /*
+     * Several identities are expanded side by side, each by one thread
+     * into its own buffer; a single identity is instead spread over the
+     * threads by CreateSubs().
+     */
+    const int threads = std::max(1, std::min((int)active.size(), omp_get_max_threads()));
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(threads > 1)
+    for (int i=0; i<(int)active.size(); i++) {
+        int id_status;
+#pragma omp atomic read
+        id_status = status;
+        if (id_status != OK)
+            continue;
+
+        Generation_context ctx(*active[i], n, builder);
+        id_status = GenerateEquations(ctx);
+#pragma omp atomic
+        W.pruned_subs += ctx.pruned_substitutions;
+#pragma omp atomic
+        W.pruned_perms += ctx.pruned_permutations;
+#pragma omp atomic
+        W.memo_hits += ctx.memo_hits;
+#pragma omp atomic
+        W.memo_lookups += ctx.memo_lookups;
+#pragma omp atomic
+        W.memo_saved += ctx.memo_saved;
+        if (id_status != OK) {
+#pragma omp atomic write
+            status = id_status;
         }
+    }
 
-	if(sigIntFlag == 1){		/* TW 10/5/93 - Ctrl-C check */
-	  return(-1);
-	}
+    if(sigIntFlag == 1){		/* TW 10/5/93 - Ctrl-C check */
+      return(-1);
     }
 
     if (status == OK) {
-#if 1
-   {
-     int tt=0;
-     for(int i=0; i<(int)equations.size(); i++) {
-       tt += equations[i].size();
-     } 
-     printf("neqn:%d (ne:%d MB:%.2f)...", (int)equations.size(), tt, tt*sizeof(Basis_pair)/1024./1024.); fflush(NULL);
-   }
-#endif
-
-#if DEBUG_EQNS
-    PrintEqns(equations);
-#endif
-
-    printf("(%lds)...Solving...", ElapsedTime()); fflush(NULL);
-    status = SparseCreateTheMatrix(equations, SM, &cols, BPtoCol, n);
+      status = builder.Finish(&W.cols, W.BPtoCol);
+      W.neqn = builder.NumEquations();
+      W.nterms = builder.NumTerms();
+      W.peak_mb = builder.PeakMB();
+      W.dropped = builder.NumDiscarded();
+    }
 
-    //printf("BPtoCol:(%d MB:%.2f)...", (int)BPtoCol.size(), BPtoCol.size()*sizeof(Unique_basis_pair)/1024./1024.);
-  }
+    if (status == OK && Verbose) {
+      printf("neqn:%ld (ne:%ld MB:%.2f)...", W.neqn, W.nterms, W.peak_mb); fflush(NULL);
+      if (W.pruned_subs > 0 || W.pruned_perms > 0) {
+        printf("pruned:%ld (perms:%ld)...", W.pruned_subs, W.pruned_perms); fflush(NULL);
+      }
+      if (W.memo_lookups > 0) {
+        printf("memo:%.0f%% %.2fs...", 100. * W.memo_hits / W.memo_lookups, W.memo_saved); fflush(NULL);
+      }
+      long hits, lookups;
+      double mb;
+      GetEnumerationCacheStats(&hits, &lookups, &mb);
+      if (lookups > 0) {
+        /* Lookups answered from the cache of another identity. */
+        printf("enum:%ld/%ld (MB:%.2f)...", hits, lookups, mb); fflush(NULL);
+      }
+      if (Online_reduction) {
+        printf("dropped:%ld...", W.dropped); fflush(NULL);
+      }
+      printf("(%lds)...Solving...", ElapsedTime()); fflush(NULL);
+    }
   }
 
-
   if (status == OK) { /*SM.shrink_to_fit();*/
-      status = SolveEquations(SM, cols, BPtoCol, n);			
-      
-      printf("(%lds)\n", ElapsedTime());
+      status = SolveEquations(W, Verbose);
   }
 
   return(status);
 }
 
 /*******************************************************************/
-/* REQUIRES:                                                       */
-/*     L -- Head to List of Equations.                             */ 
-/*     t -- Current Type being processed.                          */
+/* MODIFIES:                                                       */
+/*     W -- SM reduced, rank set.                                  */
 /* FUNCTION:                                                       */
-/*     Convert the given list of equations into Matrix, i.e one    */
-/*     row for each equation and one column for each unique basis  */
-/*     pair present in all equations.                              */
-/*     Then Reduce that Matrix into row canonical form.            */
-/*     Then Extract from the Reduced Matrix i.e Find New Basis     */
-/*     and enter them into Basis Table. Then write Dependent Basis */
-/*     pairs into Basis by entering products into Mult_table.      */ 
+/*     The Matrix has one row for each equation and one column for */
+/*     each unique basis pair present in all equations.            */
+/*     Reduce that Matrix into row canonical form.                 */
 /*******************************************************************/
-int SolveEquations(SparseMatrix &SM, int cols, vector<Unique_basis_pair> &BPtoCol, Name n)
+int SolveEquations(Type_work &W, bool Verbose)
 {
+  SparseMatrix &SM = W.SM;
+  const int cols = W.cols;
+
 #if DEBUG_MATRIX
    PrintColtoBP();
    PrintTheMatrix();
@@ -330,28 +534,80 @@ int SolveEquations(SparseMatrix &SM, int cols, vector<Unique_basis_pair> &BPtoCo
   }
 
     int rank = 0;
+    W.rows = SM.size();
+    W.fill[0] = (double)tt / (SM.size() * cols) * 100.;
+    W.matrix_mb[0] = tt*sizeof(Node)/1024./1024.;
     // printf("Matrix:(%4d X %4d (%.2f%% %d MB:%.2f)", (int)SM.size(), cols, (double)tt / (SM.size() * cols) * 100., tt, tt*sizeof(Node)/1024./1024.); fflush(NULL);
-     printf("Matrix:(%4d X %4d (%.1f%% %.1fMB)->", (int)SM.size(), cols, (double)tt / (SM.size() * cols) * 100., tt*sizeof(Node)/1024./1024.); fflush(NULL);
-     int status = SparseReduceMatrix(SM,cols,&rank);
+    if (Verbose) {
+     printf("Matrix:(%4d X %4d (%.1f%% %.1fMB)->", W.rows, cols, W.fill[0], W.matrix_mb[0]); fflush(NULL);
+    }
+     int status = SparseReduceMatrix(SM,cols,&rank,Verbose);
+     W.rank = rank;
 
  tt = 0;
   for(int i=0; i<(int)SM.size(); i++) {
     tt += SM[i].size();
   }
+    W.fill[1] = (double)tt / (SM.size() * cols) * 100.;
+    W.matrix_mb[1] = tt*sizeof(Node)/1024./1024.;
      //printf("->(%.2f%% %d MB:%.2f))", (double)tt / (SM.size() * cols) * 100., tt, tt*sizeof(Node)/1024./1024.); fflush(NULL);
-     printf("(%.1f%% %.1fMB))", (double)tt / (SM.size() * cols) * 100., tt*sizeof(Node)/1024./1024.); fflush(NULL);
+    if (Verbose) {
+     printf("(%.1f%% %.1fMB))", W.fill[1], W.matrix_mb[1]); fflush(NULL);
+    }
 
 #if DEBUG_MATRIX
    PrintTheRMatrix();
 #endif
 
-/* ExtractMatrix will expand basis table & MultTable ! */
-  if (status == OK) {
-	status = SparseExtractFromMatrix(SM,cols,rank,n, BPtoCol);
- }
+   return(status);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     W -- extraction filled from the reduced matrix, which is    */
+/*          then freed.                                            */
+/* REQUIRES:                                                       */
+/*     W.extraction.first_basis -- number of the type's first new  */
+/*     basis element.                                              */
+/* FUNCTION:                                                       */
+/*     Extract from the Reduced Matrix i.e Find New Basis and      */
+/*     write Dependent Basis pairs in terms of Basis.              */
+/*******************************************************************/
+int ExtractType(Type_work &W)
+{
+    int status = SparseExtractFromMatrix(W.SM, W.cols, W.rank, W.n, W.BPtoCol, W.extraction);
 #if DEBUG_MATRIX
    PrintDependent();
 #endif
 
-   return(status);
+    SparseMatrix().swap(W.SM);
+    vector<Unique_basis_pair>().swap(W.BPtoCol);
+
+    return(status);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Basis_table, Mult_table, Type_table -- the new basis        */
+/*     elements and products of type W.n are entered.              */
+/* REQUIRES:                                                       */
+/*     Verbose -- print the statistics of the type collected by    */
+/*     ProcessType(), for types processed concurrently, which      */
+/*     could not print them as they went.                          */
+/*******************************************************************/
+int CommitType(Type_work &W, bool Verbose)
+{
+    if (Verbose) {
+        printf("\t\tne:%ld MB:%.2f", W.nterms, W.peak_mb);
+        if (W.memo_lookups > 0)
+            printf(" memo:%.0f%% %.2fs", 100. * W.memo_hits / W.memo_lookups, W.memo_saved);
+        if (Online_reduction)
+            printf(" dropped:%ld", W.dropped);
+        printf(" Matrix:(%4d X %4d (%.1f%% %.1fMB)->(%.1f%% %.1fMB))\n",
+               W.rows, W.cols, W.fill[0], W.matrix_mb[0], W.fill[1], W.matrix_mb[1]);
+    }
+
+    return(CommitExtraction(W.extraction));
 }
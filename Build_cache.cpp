@@ -0,0 +1,238 @@
+/*******************************************************************/
+/***  FILE :        Build_cache.c                                ***/
+/***  PUBLIC ROUTINES:                                           ***/
+/***      int CacheLookup()                                      ***/
+/***      void CacheStore()                                      ***/
+/***      int CachedDegree()                                     ***/
+/***  PRIVATE ROUTINES:                                          ***/
+/***      void CacheFile()                                       ***/
+/***      void EvictCache()                                      ***/
+/***      bool StalePart()                                       ***/
+/***  MODULE DESCRIPTION:                                        ***/
+/***      A directory of tables saved by build, named by a hash  ***/
+/***      of all they depend on: the identities, the field and   ***/
+/***      the target type cut down to the degree they reach.     ***/
+/***      Tables are saved at the end of every degree, which     ***/
+/***      costs little next to building it, so a configuration   ***/
+/***      that agrees with an earlier one up to some degree      ***/
+/***      starts from its tables there.  Files are written whole ***/
+/***      and renamed into place, so concurrent sessions may     ***/
+/***      share the directory.  Once it holds more than          ***/
+/***      Cache_limit MB the least recently used tables are      ***/
+/***      removed, and the part files of writers that died on    ***/
+/***      this host, or that were left a day ago, are removed    ***/
+/***      always.                                                ***/
+/*******************************************************************/
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "Build_cache.h"
+#include "Build_defs.h"
+#include "driver.h"
+#include "Id_routines.h"
+#include "Table_file.h"
+#include "Type_table.h"
+
+using namespace std;
+
+static void CacheFile(const list<id_queue_node> &Id_queue, int Degree, string &File);
+static void EvictCache(void);
+static bool StalePart(const char *Name, time_t Modified);
+
+static int Cached_degree = 0;       /* Of the last CacheLookup(). */
+
+/* A file of the cache, for eviction. */
+struct Cache_entry {
+    Cache_entry() : used(0), size(0), path() {}
+
+    time_t used;
+    off_t size;
+    string path;
+
+    bool operator<(const Cache_entry &E) const { return used < E.used; }
+};
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     The Type table created for the target, the Basis and        */
+/*     Multiplication tables empty.                                */
+/* RETURNS:                                                        */
+/*     The highest degree through which tables were loaded from    */
+/*     the cache, 0 if none were.                                  */
+/*******************************************************************/
+int CacheLookup(const list<id_queue_node> &Id_queue, int Target_degree)
+{
+    Cached_degree = 0;
+    if (Cache_dir == NULL)
+        return(0);
+
+    string file;
+    for (int d = Target_degree; d >= 2; d--) {
+        CacheFile(Id_queue, d, file);
+        if (LoadTablesToDegree(file.c_str(), Id_queue, d, false) == OK) {
+            utimes(file.c_str(), NULL);     /* Most recently used. */
+            Cached_degree = d;
+            break;
+        }
+    }
+
+    return(Cached_degree);
+}
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     The tables complete through Degree.                         */
+/* FUNCTION:                                                       */
+/*     Save them in the cache, unless they are there already, then */
+/*     bring the cache back under its limit.                       */
+/*******************************************************************/
+void CacheStore(const list<id_queue_node> &Id_queue, int Degree)
+{
+    if (Cache_dir == NULL)
+        return;
+
+    mkdir(Cache_dir, 0777);
+
+    string file;
+    CacheFile(Id_queue, Degree, file);
+    if (access(file.c_str(), F_OK) == 0)
+        utimes(file.c_str(), NULL);
+    else if (SaveTables(file.c_str(), Id_queue, Degree) != OK)
+        return;
+
+    EvictCache();
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     The degree through which the last build was loaded from the */
+/*     cache, 0 if it was not.                                     */
+/*******************************************************************/
+int CachedDegree(void)
+{
+    return(Cached_degree);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     File -- the cache file of the tables through Degree: a      */
+/*             64 bit FNV-1a hash of the file version, the field,  */
+/*             the target cut down to Degree, Degree and the       */
+/*             canonical identities.                               */
+/*******************************************************************/
+void CacheFile(const list<id_queue_node> &Id_queue, int Degree, string &File)
+{
+    string key;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%d %d %d ", TABLE_FILE_VERSION, GetField(), Degree);
+    key = buf;
+    const Packed_type target = ClampType(GetTargetType(), Degree);
+    key.append((const char *) &target, sizeof(target));
+    string ids;
+    CanonicalIdentities(Id_queue, ids);
+    key += ids;
+
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < (int) key.size(); i++) {
+        h ^= (unsigned char) key[i];
+        h *= 1099511628211ULL;
+    }
+
+    snprintf(buf, sizeof(buf), "/%016llx.tab", (unsigned long long) h);
+    File = Cache_dir;
+    File += buf;
+}
+
+
+/*******************************************************************/
+/* FUNCTION:                                                       */
+/*     Remove the part files that StalePart() finds, then the      */
+/*     least recently used tables of the cache until it holds at   */
+/*     most Cache_limit MB.  Only finished files, ending in .tab,  */
+/*     count.                                                      */
+/*******************************************************************/
+void EvictCache(void)
+{
+    DIR *dir = opendir(Cache_dir);
+    if (dir == NULL)
+        return;
+
+    vector<Cache_entry> entries;
+    double total = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        const size_t len = strlen(de->d_name);
+        const bool part = strstr(de->d_name, ".tab.") != NULL;
+        if (!part && (len < 4 || strcmp(de->d_name + len - 4, ".tab") != 0))
+            continue;
+        Cache_entry e;
+        e.path = string(Cache_dir) + "/" + de->d_name;
+        struct stat st;
+        if (stat(e.path.c_str(), &st) != 0)
+            continue;
+        if (part) {
+            if (StalePart(de->d_name, st.st_mtime))
+                unlink(e.path.c_str());
+            continue;
+        }
+        e.used = st.st_mtime;
+        e.size = st.st_size;
+        total += st.st_size;
+        entries.push_back(e);
+    }
+    closedir(dir);
+
+    sort(entries.begin(), entries.end());
+    const double limit = Cache_limit * 1048576.0;
+    for (int i = 0; i < (int) entries.size() && total > limit; i++) {
+        if (unlink(entries[i].path.c_str()) == 0)
+            total -= entries[i].size;
+    }
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     true if Name is a part file, "<table>.tab.<host>.<pid>" as  */
+/*     SaveTables() writes it, which has not been written for a    */
+/*     day, or whose writer on this host has died.  A pid is only  */
+/*     looked up here when the host is this one.                   */
+/*     false otherwise.                                            */
+/*******************************************************************/
+bool StalePart(const char *Name, time_t Modified)
+{
+    if (time(NULL) - Modified > 86400)
+        return(true);
+
+    const char *host = strstr(Name, ".tab.") + 5;
+    const char *pid = strrchr(Name, '.') + 1;
+    char *end;
+    const long p = strtol(pid, &end, 10);
+    if (pid <= host || *pid == '\0' || *end != '\0' || p <= 0)
+        return(false);
+
+    char here[256] = "";
+    gethostname(here, sizeof(here) - 1);
+    if (strlen(here) != (size_t) (pid - 1 - host) || strncmp(host, here, pid - 1 - host) != 0)
+        return(false);
+
+    return(kill((pid_t) p, 0) != 0 && errno == ESRCH);
+}
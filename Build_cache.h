@@ -0,0 +1,19 @@
+#ifndef _BUILD_CACHE_H_
+#define _BUILD_CACHE_H_
+
+/*******************************************************************/
+/***  FILE :        Build_cache.h                                ***/
+/*******************************************************************/
+
+#include <list>
+
+#include "Id_routines.h"
+
+extern const char *Cache_dir;       /* NULL for no cache; set by -k. */
+extern long Cache_limit;            /* MB; set by -K. */
+
+int CacheLookup(const std::list<id_queue_node> &Id_queue, int Target_degree);
+void CacheStore(const std::list<id_queue_node> &Id_queue, int Degree);
+int CachedDegree(void);
+
+#endif
@@ -13,6 +13,12 @@
 
 #define DEFAULT_FIELD      251
 
+#define DEFAULT_EQUATION_MEM_LIMIT  256  /* MB of equations held before they become matrix rows */
+#define DEFAULT_CACHE_LIMIT        1024  /* MB of build cache kept before the oldest tables go */
+#define SUB_MEMO_LIMIT           100000  /* Subterm expansions remembered per thread */
+#define EQUATION_BATCH_SIZE        4096  /* Substitutions x permutations evaluated per batch */
+#define ENUMERATION_CACHE_LIMIT (16L << 20)  /* Bytes of set partitions kept for reuse per type */
+
 #define TRUE    1
 #define FALSE   0
 
@@ -13,38 +13,44 @@
 /***                values within it                             ***/
 /***                                                             ***/
 /***  PUBLIC ROUTINES:                                           ***/
-/***      int CreateMatrix()                                     ***/
-/***      int SparseCreateTheMatrix()                            ***/
+/***      Matrix_builder::Matrix_builder()                       ***/
+/***      Matrix_builder::~Matrix_builder()                      ***/
+/***      int Matrix_builder::Flush()                            ***/
+/***      int Matrix_builder::Finish()                           ***/
+/***      int GetCol()                                           ***/
 /***  PRIVATE ROUTINES:                                          ***/
+/***      long Matrix_builder::PairIndex()                       ***/
+/***      void Matrix_builder::PairOf()                          ***/
+/***      int Matrix_builder::FindColumn()                       ***/
+/***      int Matrix_builder::AddColumn()                        ***/
+/***      int Matrix_builder::Append()                           ***/
+/***      void Matrix_builder::Reduce()                          ***/
+/***      void Matrix_builder::ReduceAgainstPivots()             ***/
 /***  MODULE DESCRIPTION:                                        ***/
 /***      This module contains routines dealing with creating    ***/
 /***      a Matrix for the given list of equations. (i.e list of ***/
 /***      Basis pairs.                                           ***/ 
-/***      1) Initialize PairPresent bit Matrix to 0's.           ***/
-/***      2) Compute 'N', the number of distinct Basis pairs     ***/
-/***         present in the given list of equations.             ***/
-/***      3) malloc ColtoBP array of 'N' pairs w.o coefficients. ***/  
-/***      4) Fill the ColtoBP array with the distinct Bais pairs.***/
-/***         Use the PairPresent bit Matrix while filling.       ***/
-/***      5) Allocate space for the Matrix of equations.         ***/
-/***         It's number of rows is equal to number of equations.***/
-/***         And number of columns equal to 'N'.                 ***/
-/***         ZeroOut the Matrix.                                 ***/
-/***         For each equation, one row of the Matrix is filled. ***/
-/***         For each Basis pair in the equation, scan the array ***/
-/***         to find the column number. It is nothing but the    ***/
-/***         position where we could find the required Basis pair***/
-/***         Enter the Scalar corresponding to the Basis pair in ***/
-/***         the equaition into the Matrix in the corresponding  ***/
-/***         column.                                             ***/ 
+/***      1) Number every basis pair (l,r) whose types add up to ***/
+/***         the current type, in ascending order of l and then  ***/
+/***         r, without laying out columns for them.             ***/
+/***      2) As batches of equations arrive, give each basis     ***/
+/***         pair the next column when it first occurs and fill  ***/
+/***         one row of the Matrix per equation.                 ***/
+/***      3) When all equations have been seen, renumber the     ***/
+/***         columns in order of their basis pairs and fill the  ***/
+/***         ColtoBP array with them.                            ***/
+/***      With online reduction, step 2 also reduces each new    ***/
+/***      row against the rows kept so far and drops it unless   ***/
+/***      it has a new pivot, so the Matrix holds at most rank   ***/
+/***      rows.                                                  ***/
 /*******************************************************************/
 
 #include <algorithm>
-#include <list>
 #include <vector>
 
-using std::fill;
-using std::list;
+using std::pair;
+using std::make_pair;
+using std::sort;
 using std::vector;
 
 #include <stdio.h>
@@ -61,200 +67,388 @@ using std::vector;
 #include "SparseReduceMatrix.h"
 #include "Type_table.h"
 
-#include <set>
-
-using std::set;
-using std::pair;
-using std::make_pair;
+extern int Equation_mem_limit;
+extern int Online_reduction;
 
-static set<pair<int, int> > pp;
+#define MAX_MATRIX_COLS 0x00ffffff  /* Limit of the column field of struct Node. */
+#define MIN_SLOT_BITS   10
 
-inline int pp_contains(int r, int c) {
-  return pp.find(make_pair(r, c)) != pp.end();
-}
+/* Orders the nodes of a row by column. */
+struct Node_column_less {
+    bool operator()(const Node &N1, const Node &N2) const { return N1.getColumn() < N2.getColumn(); }
+};
 
-static void FillPairPresent(const Equations &equations);
-static void CreateColtoBP(Name N, vector<Unique_basis_pair> &ColtoBP);
-static bool AreBasisElements(Degree d);
-static void Process(vector<Unique_basis_pair> &ColtoBP, Degree d1, Degree d2, int *col_to_bp_index_ptr);
-static int SparseFillTheMatrix(const Equations &equations, const vector<Unique_basis_pair> &ColtoBP, SparseMatrix &SM);
 #if 0
 static void PrintPairPresent(void);
 static void PrintColtoBP(void);
 static void PrintTheMatrix(void);
 #endif
 
-/* Added by DCL (8/92). This is virtually identical to CreateTheMatrix()
-   except that we call SparseFillTheMatrix() and copy the Matrix ptr to
-   a pointer internal to this module to be altered and then copy it back
-   before returning to SolveEquations() in Build.c */
 
-int SparseCreateTheMatrix(const Equations &equations, SparseMatrix &SM, int *Cols, vector<Unique_basis_pair> &ColtoBP, Name n)
+Matrix_builder::Matrix_builder(Name n, SparseMatrix &SM_)
+  : SM(SM_), lock(), buffered_terms(0), segments(), col_index(), slot_index(1 << MIN_SLOT_BITS, -1),
+    slot_col(1 << MIN_SLOT_BITS, 0), slot_bits(MIN_SLOT_BITS), online(Online_reduction != 0), pivot_row(),
+    n_equations(0), n_discarded(0), n_terms(0), peak_terms(0)
 {
-    pp.clear();
-    ColtoBP.clear();
+    const int d = GetDegreeName(n);
+
+    for (int i=1; i<d; i++) {
+        const Name *subtypes, *complements;
+        int num = SubtypesOfDegree(n, i, &subtypes, &complements);
+        for (int k=0; k<num; k++) {
+            Name t = subtypes[k];
+            Name c = complements[k];
+            if (BeginBasis(t) == 0 || BeginBasis(c) == 0)
+                continue;
+
+            Segment sg;
+            sg.left_begin = BeginBasis(t);
+            sg.left_end = EndBasis(t);
+            sg.right_begin = BeginBasis(c);
+            sg.right_len = EndBasis(c) - BeginBasis(c) + 1;
+            sg.offset = 0;
+            segments.push_back(sg);
+        }
+    }
 
-    FillPairPresent(equations);
-/*
-    PrintPairPresent();
-*/
-    CreateColtoBP(n, ColtoBP);
+    /* Basis numbers do not follow type names within a degree. */
+    sort(segments.begin(), segments.end());
 
-#if 0
-    {
-      for(int i=0; i<ColtoBP.size(); i++) {
-        printf("cbp %d %d %d\n", i, ColtoBP[i].left_basis, ColtoBP[i].right_basis);
-      }
+    long pairs = 0;
+    for (int i=0; i<(int)segments.size(); i++) {
+        segments[i].offset = pairs;
+        pairs += (long)(segments[i].left_end - segments[i].left_begin + 1) * segments[i].right_len;
     }
-#endif
-    
-    if (SparseFillTheMatrix(equations, ColtoBP, SM) != OK)
-        return(0);
 
-#if 0
-    {
-      for(int i=0; i<SM.size(); i++) {
-        const SparseRow &row = SM[i];
-        vector<Node>::const_iterator j;
-        printf("%d", i);
-        for(j=row.begin(); j!=row.end(); j++) {
-          printf("\t(%d %d)", j->getColumn(), j->getElement());
-        }
-        putchar('\n');
-      }
-    }
-#endif
-    
-    *Cols = pp.size();
+    omp_init_lock(&lock);
+}
 
-    pp.clear();
 
-    return(OK);
+Matrix_builder::~Matrix_builder()
+{
+    omp_destroy_lock(&lock);
 }
 
 
+/*
+ * Place of the pair among all pairs of the type.
+ */
+long Matrix_builder::PairIndex(Basis Left_basis, Basis Right_basis) const
+{
+    int low = 0;
+    int high = segments.size() - 1;
 
-void FillPairPresent(const Equations &equations)
+    while (low < high) {
+        int middle = (low + high + 1)/2;
+        if (Left_basis < segments[middle].left_begin)
+            high = middle - 1;
+        else
+            low = middle;
+    }
+
+    const Segment &sg = segments[low];
+    return sg.offset + (long)(Left_basis - sg.left_begin) * sg.right_len + (Right_basis - sg.right_begin);
+}
+
+
+/*
+ * The pair at place Index, as PairIndex() numbers them.
+ */
+void Matrix_builder::PairOf(long Index, Unique_basis_pair &Bp) const
+{
+    int low = 0;
+    int high = segments.size() - 1;
+
+    while (low < high) {
+        int middle = (low + high + 1)/2;
+        if (Index < segments[middle].offset)
+            high = middle - 1;
+        else
+            low = middle;
+    }
+
+    const Segment &sg = segments[low];
+    Bp.left_basis = sg.left_begin + (Index - sg.offset) / sg.right_len;
+    Bp.right_basis = sg.right_begin + (Index - sg.offset) % sg.right_len;
+}
+
+
+/*
+ * Column of the pair at place Index, -1 if it has not occurred.  Safe
+ * to call from several threads while no column is added.
+ */
+int Matrix_builder::FindColumn(long Index) const
 {
-  Equations::const_iterator ii;
-  for(ii = equations.begin(); ii != equations.end(); ii++) {
-    Equation::const_iterator jj;
-    for(jj = ii->begin(); jj != ii->end() /*&& (jj->coef != 0)*/; jj++) {
-      std::vector<Basis_pair>::const_iterator kk; 
-      for(kk = jj->begin(); kk != jj->end() /*&& (jj->coef != 0)*/; kk++) {
-        pp.insert(make_pair(kk->left_basis, kk->right_basis));
-      }
+    const unsigned long mask = (1UL << slot_bits) - 1;
+    for (unsigned long s = (Index * 0x9e3779b97f4a7c15UL) >> (64 - slot_bits); ; s = (s + 1) & mask) {
+        if (slot_index[s] == Index)
+            return slot_col[s];
+        if (slot_index[s] < 0)
+            return -1;
     }
-  }
 }
 
-              
-void CreateColtoBP(Name N, vector<Unique_basis_pair> &ColtoBP)
+
+/*
+ * Column of the pair at place Index, the next one if it has not
+ * occurred; -1 if there would be more than MAX_MATRIX_COLS columns.
+ */
+int Matrix_builder::AddColumn(long Index)
 {
-    const int Num_unique_basis_pairs = pp.size();
-
-    if (Num_unique_basis_pairs > 0) {
-      ColtoBP.resize(Num_unique_basis_pairs);
-  
-      const Degree d = GetDegreeName(N);
-      int col_to_bp_index = 0;
-     
-      for (int i=1; i<d; i++) {
-        /*  	This check added 5/94   (DPJ)    */
-        if ( AreBasisElements(i) && AreBasisElements(d-i) ) {
-            Process(ColtoBP, i, d-i, &col_to_bp_index);
+    const int found = FindColumn(Index);
+    if (found >= 0)
+        return found;
+    if ((long)col_index.size() >= MAX_MATRIX_COLS)
+        return -1;
+
+    /* At most half the slots are used, so probes stay short. */
+    if (2 * (col_index.size() + 1) > slot_index.size()) {
+        slot_bits++;
+        vector<long>(1UL << slot_bits, -1).swap(slot_index);
+        vector<int>(1UL << slot_bits, 0).swap(slot_col);
+        const unsigned long mask = (1UL << slot_bits) - 1;
+        for (int c=0; c<(int)col_index.size(); c++) {
+            unsigned long s = (col_index[c] * 0x9e3779b97f4a7c15UL) >> (64 - slot_bits);
+            while (slot_index[s] >= 0)
+                s = (s + 1) & mask;
+            slot_index[s] = col_index[c];
+            slot_col[s] = c;
         }
-      }
     }
+
+    const unsigned long mask = (1UL << slot_bits) - 1;
+    unsigned long s = (Index * 0x9e3779b97f4a7c15UL) >> (64 - slot_bits);
+    while (slot_index[s] >= 0)
+        s = (s + 1) & mask;
+    slot_index[s] = Index;
+    slot_col[s] = col_index.size();
+    col_index.push_back(Index);
+
+    return slot_col[s];
 }
 
-/*
-5/94 (DPJ)
-Returns true if there are basis elements at degree d.
-Note: when the algebra is nilpotent it is possible
-that no new basis elements were entered at degree d.
-*/
-bool AreBasisElements(Degree d)
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     SM -- one row is appended for each buffered equation.       */
+/*     Buffer -- emptied if flushed.                               */
+/* REQUIRES:                                                       */
+/*     force -- flush even if the buffer is below its share of     */
+/*              Equation_mem_limit.                                */
+/* RETURNS:                                                        */
+/*     1 if successfull.                                           */
+/*     0 otherwise.                                                */
+/*******************************************************************/
+int Matrix_builder::Flush(Equation_buffer &Buffer, bool force)
 {
-   return BasisStart(d) != 0;
+    const Equations &pending = Buffer.equations;
+
+    long new_terms = 0;
+    for (; Buffer.scanned < (int)pending.size(); Buffer.scanned++) {
+        const Equation &eqn = pending[Buffer.scanned];
+        for (int i=0; i<(int)eqn.size(); i++)
+            new_terms += eqn[i].size();
+    }
+    Buffer.terms += new_terms;
+
+    /* Buffers filled side by side, by any enclosing team, share the limit. */
+    int sharing = 1;
+    for (int level=1; level<=omp_get_level(); level++)
+        sharing *= omp_get_team_size(level);
+    const double limit = Equation_mem_limit * 1024. * 1024. / sharing;
+
+    int status = OK;
+    omp_set_lock(&lock);
+    buffered_terms += new_terms;
+    if (buffered_terms > peak_terms)
+        peak_terms = buffered_terms;
+
+    if (force || Buffer.terms * sizeof(Basis_pair) >= limit)
+        status = Append(Buffer);
+    omp_unset_lock(&lock);
+
+    return(status);
 }
 
 
-void Process(vector<Unique_basis_pair> &ColtoBP, Degree d1, Degree d2, int *col_to_bp_index_ptr)
+/*
+ * Turns the equations of Buffer into rows of SM and empties it.
+ * Callers hold the lock.
+ */
+int Matrix_builder::Append(Equation_buffer &Buffer)
 {
-    const Basis b1 = BasisStart(d1);
-    const Basis b2 = BasisEnd(d1);
-    const Basis b3 = BasisStart(d2);
-    const Basis b4 = BasisEnd(d2);
-
-    for (Basis i=b1; i<=b2; i++) {
-        for (Basis j=b3; j<=b4; j++) {
-          if(pp_contains(i, j)) {
-                ColtoBP[*col_to_bp_index_ptr].left_basis = i; 
-                ColtoBP[*col_to_bp_index_ptr].right_basis = j; 
-                (*col_to_bp_index_ptr)++;
+    Equations &pending = Buffer.equations;
+
+    if (pending.empty())
+        return(OK);
+
+    /* New pairs are given their columns before the rows are filled. */
+    for (int eq_number=0; eq_number < (int)pending.size(); eq_number++) {
+        const Equation &eqn = pending[eq_number];
+        for (int i=0; i<(int)eqn.size(); i++) {
+            for (int j=0; j<(int)eqn[i].size(); j++) {
+                if (AddColumn(PairIndex(eqn[i][j].left_basis, eqn[i][j].right_basis)) < 0) {
+                    printf("Too many basis pairs for one matrix.\n");
+                    return(0);
+                }
+            }
+        }
+    }
+    if (online)
+        pivot_row.resize(col_index.size(), -1);
+
+    const int se = SM.size();
+    SM.resize(se + pending.size());
+
+#pragma omp parallel for schedule(dynamic, 10)
+    for (int eq_number=0; eq_number < (int)pending.size(); eq_number++) {
+        const Equation &eqn = pending[eq_number];
+
+        vector<pair<int, Scalar> > terms;
+        for (int i=0; i<(int)eqn.size(); i++) {
+            for (int j=0; j<(int)eqn[i].size(); j++) {
+                const int col = FindColumn(PairIndex(eqn[i][j].left_basis, eqn[i][j].right_basis));
+                terms.push_back(make_pair(col, eqn[i][j].coef));
+            }
+        }
+        sort(terms.begin(), terms.end());
+
+        SparseRow t_row;
+        for (int i=0; i<(int)terms.size();) {
+            const int col = terms[i].first;
+            Scalar t = S_zero();
+            for (; i<(int)terms.size() && terms[i].first == col; i++)
+                t = S_add(t, terms[i].second);
+
+            if (t != S_zero()) {
+                Node node = Node();
+                node.setColumn(col);
+                node.setElement(t);
+                t_row.push_back(node);
+            }
+        }
+
+        SparseRow &d_row = SM[se + eq_number];
+        SparseRow(t_row.begin(), t_row.end()).swap(d_row); // shrink capacity while assigning 
+    }
+
+    const int old_rows = SM.size();
+    if (online) {
+        Reduce(se);
+    } else {
+        /* Rows that cancelled out entirely carry no information. */
+        int j = se;
+        for (int i=se; i<(int)SM.size(); i++) {
+            if (!SM[i].empty()) {
+                if (i != j)
+                    SM[j].swap(SM[i]);
+                j++;
             }
         }
+        SM.resize(j);
     }
+
+    n_discarded += old_rows - SM.size();
+    n_equations += pending.size();
+    n_terms += Buffer.terms;
+    buffered_terms -= Buffer.terms;
+
+    Equations().swap(pending);
+    Buffer.terms = 0;
+    Buffer.scanned = 0;
+
+    return(OK);
 }
-            
 
-int SparseFillTheMatrix(const Equations &equations, const vector<Unique_basis_pair> &ColtoBP, SparseMatrix &SM)
+
+/*
+ * Subtract multiples of the kept rows 0..Num_pivot_rows-1 from row Row
+ * until its leading column is not the pivot of one of them, or the row
+ * is zero.
+ */
+void Matrix_builder::ReduceAgainstPivots(int Row, int Num_pivot_rows)
 {
-  if (ColtoBP.empty() || equations.empty())
-    return(OK);
+    while (!SM[Row].empty()) {
+        const Node &lead = SM[Row].front();
+        const int p = pivot_row[lead.getColumn()];
+        if (p < 0 || p >= Num_pivot_rows)
+            return;
+        SparseAddRow(SM, S_minus(lead.getElement()), p, Row);
+    }
+}
 
-  const int se = SM.size();
-  SM.resize(se + equations.size());
 
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     SM -- rows First_row.. are reduced against the kept rows;   */
+/*           those with a new pivot are kept, scaled to a leading  */
+/*           one, and the rest are removed.                        */
+/* REQUIRES:                                                       */
+/*     Rows 0..First_row-1 have distinct pivots recorded in        */
+/*     pivot_row, each with a leading one.                         */
+/*******************************************************************/
+void Matrix_builder::Reduce(int First_row)
+{
+    /* The kept rows do not change while the batch is reduced against them. */
 #pragma omp parallel for schedule(dynamic, 10)
-  for(int eq_number=0; eq_number < (int)equations.size(); eq_number++) {
-    const Equation &eqn = equations[eq_number];
-    SparseRow t_row;
-
-    for(int i=0; i<(int)eqn.size() /* && eqn[i].coef != 0*/; i++) {
-    for(int j=0; j<(int)eqn[i].size() /* && eqn[i].coef != 0*/; j++) {
-      const int col = GetCol(ColtoBP, eqn[i][j].left_basis, eqn[i][j].right_basis);
-      const Scalar coef = eqn[i][j].coef;
-
-      SparseRow::iterator ii;
-      for(ii = t_row.begin(); ii != t_row.end() && ii->getColumn() < col; ii++) {
-      }
-
-      if(ii == t_row.end() || ii->getColumn() != col) {
-	  /* Here we should add a node since there is no node in 
-	     the row with the column value we are looking for */
-
-          const Scalar t = S_add(S_zero(), coef);
-
-          if(t != S_zero()) {
-            Node node;
-            node.setColumn(col);
-            node.setElement(t);
-            t_row.insert(ii, node);
-          }
-      } else {
-          /* There is a node here with the same column value we are
-               looking for so add the new value to this one */
-
-          const Scalar t = S_add(ii->getElement(), coef);
-
-          if(t == S_zero()) {
-            /* If the result is zero then we will want to delete this node */
-            t_row.erase(ii);
-          } else {
-            /* the result was nonzero and we just change the node element field to the result */
-            ii->setElement(t);
-          }
-      }
+    for (int i=First_row; i<(int)SM.size(); i++)
+        ReduceAgainstPivots(i, First_row);
+
+    /* Rows of this batch may still depend on each other. */
+    int j = First_row;
+    for (int i=First_row; i<(int)SM.size(); i++) {
+        if (i != j)
+            SM[j].swap(SM[i]);
+        ReduceAgainstPivots(j, j);
+        if (SM[j].empty())
+            continue;
+
+        const Scalar x = SM[j].front().getElement();
+        if (x != S_one())
+            SparseMultRow(SM, j, S_inv(x));
+        pivot_row[SM[j].front().getColumn()] = j;
+        j++;
     }
+    SM.resize(j);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     SM -- columns renumbered in order of their basis pairs.     */
+/* REQUIRES:                                                       */
+/*     Every Equation_buffer has been flushed with force.          */
+/* RETURNS:                                                        */
+/*     *Cols -- number of distinct basis pairs in the equations.   */
+/*     ColtoBP -- the basis pair of each column.                   */
+/*     1 if successfull, 0 otherwise.                              */
+/*******************************************************************/
+int Matrix_builder::Finish(int *Cols, vector<Unique_basis_pair> &ColtoBP)
+{
+    const int n = col_index.size();
+
+    vector<pair<long, int> > order(n);
+    for (int c=0; c<n; c++)
+        order[c] = make_pair(col_index[c], c);
+    sort(order.begin(), order.end());
+
+    vector<int> rank(n);
+    ColtoBP.resize(n);
+    for (int k=0; k<n; k++) {
+        rank[order[k].second] = k;
+        PairOf(order[k].first, ColtoBP[k]);
     }
 
-    SparseRow &d_row = SM[se + eq_number];
-    SparseRow(t_row.begin(), t_row.end()).swap(d_row); // shrink capacity while assigning 
-  }
+#pragma omp parallel for schedule(dynamic, 10)
+    for (int i=0; i<(int)SM.size(); i++) {
+        for (SparseRow::iterator ii = SM[i].begin(); ii != SM[i].end(); ii++)
+            ii->setColumn(rank[ii->getColumn()]);
+        sort(SM[i].begin(), SM[i].end(), Node_column_less());
+    }
 
-  return OK;
+    *Cols = n;
+
+    return(OK);
 }
 
 
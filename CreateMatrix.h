@@ -9,7 +9,10 @@
 
 #include <vector>
 
+#include <omp.h>
+
 #include "Build_defs.h"
+#include "Memory_routines.h"
 
 struct Node {
 #if 1
@@ -46,7 +49,7 @@ struct Node {
 };
 
 typedef Scalar *Matrix;
-typedef std::vector<Node> SparseRow;
+typedef std::vector<Node, Pool_allocator<Node> > SparseRow;
 typedef std::vector<SparseRow> SparseMatrix;
 
 typedef struct {
@@ -60,10 +63,89 @@ typedef struct {
     Basis right_basis;
 } Unique_basis_pair;
 
-typedef std::vector<std::vector<Basis_pair> > Equation;
+/* The basis pairs of one substitution, from the pools. */
+typedef std::vector<Basis_pair, Pool_allocator<Basis_pair> > Basis_pair_list;
+
+typedef std::vector<Basis_pair_list> Equation;
 typedef std::vector<Equation> Equations;
 
-int SparseCreateTheMatrix(const Equations &equations, SparseMatrix &SM, int *Cols, std::vector<Unique_basis_pair> &BPCptr, Name n);
+/*
+ * Equations not yet turned into matrix rows.  Whoever generates
+ * equations owns a buffer and hands it to Matrix_builder::Flush().
+ */
+struct Equation_buffer {
+    Equation_buffer() : equations(), terms(0), scanned(0) {}
+
+    Equations equations;
+    long terms;                 /* Basis pairs in equations[0..scanned-1]. */
+    int scanned;
+};
+
+/*
+ * Builds the matrix of one type from equations delivered in batches.
+ * Equations are collected in Equation_buffers and turned into rows by
+ * Flush() once they exceed Equation_mem_limit, so the full list of
+ * equations of a type is never held at once.  Several threads may
+ * flush their own buffers; the limit is then shared between them.
+ * A basis pair (l, r) is numbered by the place it would have if every
+ * pair of the type were present, and given the next column when it
+ * first occurs, through an open addressed table of the pairs present;
+ * Finish() puts the columns in order of their pairs.  So only present
+ * pairs cost memory and count against the column limit.
+ * With online reduction each flushed batch is also reduced against the
+ * rows kept so far, and only rows with a new pivot column are kept.
+ */
+class Matrix_builder {
+public:
+    Matrix_builder(Name n, SparseMatrix &SM);
+    ~Matrix_builder();
+
+    int Flush(Equation_buffer &Buffer, bool force);
+    int Finish(int *Cols, std::vector<Unique_basis_pair> &ColtoBP);
+
+    long NumEquations() const { return n_equations; }
+    long NumDiscarded() const { return n_discarded; }
+    long NumTerms() const { return n_terms; }
+    double PeakMB() const { return peak_terms * sizeof(Basis_pair) / 1024. / 1024.; }
+
+private:
+    struct Segment {
+        Basis left_begin;
+        Basis left_end;
+        Basis right_begin;
+        int right_len;
+        long offset;
+
+        bool operator<(const Segment &s) const { return left_begin < s.left_begin; }
+    };
+
+    Matrix_builder(const Matrix_builder &);
+    Matrix_builder &operator=(const Matrix_builder &);
+
+    long PairIndex(Basis Left_basis, Basis Right_basis) const;
+    void PairOf(long Index, Unique_basis_pair &Bp) const;
+    int FindColumn(long Index) const;
+    int AddColumn(long Index);
+    int Append(Equation_buffer &Buffer);
+    void Reduce(int First_row);
+    void ReduceAgainstPivots(int Row, int Num_pivot_rows);
+
+    SparseMatrix &SM;
+    omp_lock_t lock;            /* Held while a buffer is appended. */
+    long buffered_terms;        /* Scanned but not yet flushed, all buffers. */
+    std::vector<Segment> segments;
+    std::vector<long> col_index;        /* Pair index of each column. */
+    std::vector<long> slot_index;       /* Open addressing, -1 if empty. */
+    std::vector<int> slot_col;
+    int slot_bits;
+    bool online;
+    std::vector<int> pivot_row;
+    long n_equations;
+    long n_discarded;
+    long n_terms;
+    long peak_terms;
+};
+
 int GetCol(const std::vector<Unique_basis_pair> &ColtoBP, Basis Left_basis, Basis Right_basis);
 
 #endif
@@ -4,8 +4,12 @@
 /***  PROGRAMMER:Sekhar Muddana                                    ***/
 /***  PUBLIC ROUTINES:                                             ***/
 /***      int CreateSubs()                                         ***/
+/***      int CreateMultilinearSubs()                              ***/
+/***      Substitution_generator::Substitution_generator()         ***/
+/***      int Substitution_generator::NextBatch()                  ***/
 /***  PRIVATE ROUTINES:                                            ***/
-/***      int DoCreateSubs()                                       ***/
+/***      Scalar StabilizerOrder()                                 ***/
+/***      bool IsCosetRepresentative()                             ***/
 /***  MODULE DESCRIPTION:                                          ***/
 /***      Given a set partitioning, we create substitution records ***/ 
 /***      by selecting basis elements of the type given in set     ***/
@@ -41,84 +45,271 @@
 /***                                                               ***/
 /*********************************************************************/
 
+#include <algorithm>
 #include <vector>
 
+using std::sort;
 using std::vector;
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <omp.h>
+
 #include "CreateSubs.h"
 #include "Build_defs.h"
+#include "GenerateEquations.h"
 #include "Type_table.h"
 #include "CreateMatrix.h"
 #include "Memory_routines.h"
 #include "PerformSub.h"
 #include "Po_parse_exptext.h"
+#include "Scalar_arithmetic.h"
 #include "Debug.h"
 
-//static void BuildSubs(const Name *Set_partitions, const int *Deg_var, int row, int col, vector<Basis> &tmp, vector<vector<Basis> > &Substitutions);
+#define PERMUTATION_RANGE 8L  /* Flat indices handed to a thread at a time, run as one block. */
+
+static Scalar StabilizerOrder(const Generation_context &Ctx, const vector<Basis> &S);
+static bool IsCosetRepresentative(const vector<Basis> &S, int Mdv, const vector<vector<int> > &Permutation);
 #if DEBUG_SUBSTITUTION
 static void PrintSubstitution(const vector<Basis> &Substitution);
 #endif
 
-int CreateSubs(Equations &equations, const struct polynomial *F, int nVars, int maxDegVar, const vector<vector<Basis> > &all_Substitutions, const int *Deg_var)
+/*
+ * Appends to Ctx.equations one equation per substitution record from
+ * Begin up to End, each made of one list of basis pairs per permutation.
+ *
+ * Permutations that only exchange occurrences of a variable holding the
+ * same basis element give the same list.  Only the first permutation of
+ * each such coset is expanded, with its terms multiplied by the size of
+ * the coset, i.e. the order of the stabilizer of the record; the lists
+ * of the others are left empty.
+ */
+int CreateSubs(Generation_context &Ctx, const vector<vector<Basis> > &Substitutions, int Begin, int End)
 {
     int status = OK;
  
+    Equations &equations = Ctx.equations.equations;
+    const Permutation_space &permutations = Ctx.permutations;
+    const int Mdv = Ctx.max_deg_var;
+
     int se = equations.size();
-    int as = all_Substitutions.size();
+    int as = End - Begin;
+    long ps = permutations.Size();
+
     equations.resize(se + as);
+    vector<Scalar> weight(as);
+    for(int i=0; i<as; i++) {
+        equations[se + i].resize(ps);
+        weight[i] = StabilizerOrder(Ctx, Substitutions[Begin + i]);
+    }
+
+    /* Threads take ranges of the flat (substitution, permutation) index. */
+    const long total = as * ps;
+    const long ranges = (total + PERMUTATION_RANGE - 1) / PERMUTATION_RANGE;
+    long pruned = 0;
+    long hits = 0;
+    long lookups = 0;
+    double saved = 0;
 
-    //vector<vector<vector<Basis_pair> > > res(as);
-    {
-      vector<vector<vector<int> > > permutations;
-      int ps = 0;
-      {
-        BuildPermutationLists(nVars, Deg_var, permutations);
-        ps = permutations.size();
-          for(int i=0; i<as; i++) {
-            //res[i].resize(ps);
-            equations[se + i].resize(ps);
-          }
-      }
-
-//printf("<%d %d %d>\n", all_Substitutions.size(), Substitutions.size(), permutations.size());
-#pragma omp parallel for schedule(dynamic, 2) collapse(2)
-        for(int i=0; i<as; i++) {
-          for(int j=0; j<ps; j++) {
-            status = PerformSubs(all_Substitutions[i], F, maxDegVar, permutations[j], equations[se + i][j]);
-          }
+#pragma omp parallel for schedule(dynamic) reduction(+:pruned,hits,lookups,saved)
+    for(long r=0; r<ranges; r++) {
+        long k = r * PERMUTATION_RANGE;
+        const long end = std::min(k + PERMUTATION_RANGE, total);
+
+        vector<vector<int> > permutation;
+        vector<Sub_lane> lanes;
+        permutations.Unrank(k % ps, permutation);
+        for(; k<end; k++) {
+            const vector<Basis> &S = Substitutions[Begin + k / ps];
+            if (!IsCosetRepresentative(S, Mdv, permutation)) {
+                pruned++;
+            } else {
+                lanes.push_back(Sub_lane(S, permutation, weight[k / ps], equations[se + k / ps][k % ps]));
+            }
+            permutations.Next(permutation);
         }
-      }
-
-//printf("se:%d ass:%d ", se, as);
-#if 0
-      for(int i=0; i<as; i++) {
-        LocalListToEquation(res[i], equations[se + i]);
-        //AppendLocalListToTheList(res[i], equations);
-      }
-#endif
+        if (!lanes.empty() && PerformSubs(Ctx, lanes, &hits, &lookups, &saved) != OK) {
+#pragma omp atomic write
+            status = 0;
+        }
+    }
+
+    Ctx.pruned_permutations += pruned;
+    Ctx.memo_hits += hits;
+    Ctx.memo_lookups += lookups;
+    Ctx.memo_saved += saved;
+
+    return(status);
+}
+
+
+/*
+ * CreateSubs() for an identity of degree one in every variable.  Its
+ * only permutation is the identity, which fixes nothing else, so each
+ * record is one lane of weight one and no permutation is looked at.
+ */
+int CreateMultilinearSubs(Generation_context &Ctx, const vector<vector<Basis> > &Substitutions)
+{
+    int status = OK;
+
+    Equations &equations = Ctx.equations.equations;
+    const vector<vector<int> > identity(Ctx.num_vars, vector<int>(1, 1));
+
+    const int se = equations.size();
+    const int as = Substitutions.size();
+
+    equations.resize(se + as);
+    for (int i=0; i<as; i++)
+        equations[se + i].resize(1);
+
+    const int ranges = (as + PERMUTATION_RANGE - 1) / PERMUTATION_RANGE;
+    long hits = 0;
+    long lookups = 0;
+    double saved = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:hits,lookups,saved)
+    for (int r=0; r<ranges; r++) {
+        const int begin = r * PERMUTATION_RANGE;
+        const int end = std::min(begin + (int)PERMUTATION_RANGE, as);
+
+        vector<Sub_lane> lanes;
+        for (int k=begin; k<end; k++)
+            lanes.push_back(Sub_lane(Substitutions[k], identity, S_one(), equations[se + k][0]));
+        if (PerformSubs(Ctx, lanes, &hits, &lookups, &saved) != OK) {
+#pragma omp atomic write
+            status = 0;
+        }
+    }
+
+    Ctx.memo_hits += hits;
+    Ctx.memo_lookups += lookups;
+    Ctx.memo_saved += saved;
 
     return(status);
 }
 
-void BuildSubs(const vector<Name> &Set_partitions, int maxDegVar, const int *Deg_var, int row, int col, vector<Basis> &tmp, int nVars, vector<vector<Basis> > &Substitutions) {
-    if (row >= nVars) {
+
+/*
+ * Returns the number of permutations fixing the record S, reduced
+ * into the field: the product of m! over the multiplicities m of the
+ * basis elements of each variable.
+ */
+Scalar StabilizerOrder(const Generation_context &Ctx, const vector<Basis> &S)
+{
+    Scalar order = S_one();
+    vector<Basis> v;
+
+    for (int i=0; i<Ctx.num_vars; i++) {
+        v.assign(S.begin() + i*Ctx.max_deg_var, S.begin() + i*Ctx.max_deg_var + Ctx.deg_vars[i]);
+        sort(v.begin(), v.end());
+
+        int m = 1;
+        for (int j=1; j<(int)v.size(); j++) {
+            m = (v[j] == v[j-1]) ? m+1 : 1;
+            order = S_mul(order, ConvertToScalar(m));
+        }
+    }
+
+    return(order);
+}
+
+
+/*
+ * Tells whether Permutation is the least of its coset: occurrences
+ * receiving the same basis element take the slots in increasing order.
+ */
+bool IsCosetRepresentative(const vector<Basis> &S, int Mdv, const vector<vector<int> > &Permutation)
+{
+    for (int i=0; i<(int)Permutation.size(); i++) {
+        const vector<int> &p = Permutation[i];
+        const Basis *s = &S[i*Mdv] - 1;
+        for (int k=0; k<(int)p.size(); k++)
+            for (int l=k+1; l<(int)p.size(); l++)
+                if (s[p[k]] == s[p[l]] && p[k] > p[l])
+                    return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * The substitution record is an odometer. Entry j of variable i runs
+ * over the basis elements of the type Set_partitions[j*nVars + i].
+ *
+ * The equation of a record sums over all permutations of each
+ * variable's entries, so records that differ only in the order of a
+ * variable's entries give the same equation.  Entries of equal type
+ * are adjacent, and only records in which they are nondecreasing are
+ * produced.
+ */
+Substitution_generator::Substitution_generator(const vector<Name> &Set_partitions, int nVars, int maxDegVar, const int *Deg_var)
+  : slot(), slot_begin(), slot_end(), tie(), cur(nVars * maxDegVar, 0), done(false), pruned(0)
+{
+    long all = 1;
+    long canonical = 1;
+
+    for (int row=0; row<nVars; row++) {
+        int run = 0;
+        for (int col=0; col<Deg_var[row]; col++) {
+            Name n = Set_partitions[col*nVars + row];
+            if (BeginBasis(n) == 0)
+                done = true;    /* No basis elements of that type. */
+
+            const bool tied = col > 0 && Set_partitions[(col-1)*nVars + row] == n;
+            tie.push_back(tied ? (int)slot.size() - 1 : -1);
+            slot.push_back(row*maxDegVar + col);
+            slot_begin.push_back(BeginBasis(n));
+            slot_end.push_back(EndBasis(n));
+            cur[row*maxDegVar + col] = BeginBasis(n);
+
+            /* Nondecreasing runs of length run+1 from dim elements. */
+            const long dim = EndBasis(n) - BeginBasis(n) + 1;
+            run = tied ? run+1 : 0;
+            all *= dim;
+            canonical = canonical * (dim + run) / (run + 1);
+        }
+    }
+
+    if (!done)
+        pruned = all - canonical;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Substitutions -- replaced by the next substitution records. */
+/* REQUIRES:                                                       */
+/*     Max_subs -- maximum number of records to return.            */
+/* RETURNS:                                                        */
+/*     Number of records returned; 0 once all have been returned.  */
+/*******************************************************************/
+int Substitution_generator::NextBatch(int Max_subs, vector<vector<Basis> > &Substitutions)
+{
+    Substitutions.clear();
+
+    while (!done && (int)Substitutions.size() < Max_subs) {
 #if DEBUG_SUBSTITUTION
-        PrintSubstitution(tmp);
+        PrintSubstitution(cur);
 #endif
-      Substitutions.push_back(tmp);
-    } else if (col >= Deg_var[row])
-        BuildSubs(Set_partitions, maxDegVar, Deg_var, row+1, 0, tmp, nVars, Substitutions);
-    else {
-        Basis b = FirstBasis(Set_partitions[col*nVars + row]);
-        while (b != 0) {
-            tmp[row*maxDegVar + col] = b;
-            BuildSubs(Set_partitions, maxDegVar, Deg_var, row, col+1, tmp, nVars, Substitutions);
-            b = NextBasisSameType(b);
+        Substitutions.push_back(cur);
+
+        int k;
+        for (k=slot.size()-1; k>=0; k--)
+            if (cur[slot[k]] < slot_end[k])
+                break;
+        if (k < 0) {
+            done = true;
+            break;
         }
+
+        cur[slot[k]]++;
+        for (int j=k+1; j<(int)slot.size(); j++)
+            cur[slot[j]] = tie[j] >= 0 ? cur[slot[tie[j]]] : slot_begin[j];
     }
+
+    return Substitutions.size();
 }
 
 #if DEBUG_SUBSTITUTION
@@ -5,9 +5,35 @@
 
 #include "Build_defs.h"
 #include "CreateMatrix.h"
+#include "PerformSub.h"
 #include "Po_parse_exptext.h"
 
-int CreateSubs(Equations &equations, const struct polynomial *F, int nVars, int Mdv, const std::vector<std::vector<Basis> > &all_Substitutions, const int *Deg_var_types);
-void BuildSubs(const std::vector<Name> &Set_partitions, int maxDegVar, const int *Deg_var, int row, int col, std::vector<Basis> &tmp, int nVars, std::vector<std::vector<Basis> > &Substitutions);
+/*
+ * Resumable enumeration of the substitution records of one set partition,
+ * up to the order of entries of the same type within a variable.
+ * Each call to NextBatch() continues where the previous one stopped.
+ */
+class Substitution_generator {
+public:
+    Substitution_generator(const std::vector<Name> &Set_partitions, int nVars, int maxDegVar, const int *Deg_var);
+
+    int NextBatch(int Max_subs, std::vector<std::vector<Basis> > &Substitutions);
+    bool Done() const { return done; }
+    long NumPruned() const { return pruned; }
+
+private:
+    std::vector<int> slot;          /* Position of each entry in the record. */
+    std::vector<Basis> slot_begin;
+    std::vector<Basis> slot_end;
+    std::vector<int> tie;           /* Earlier entry of the same type and variable, or -1. */
+    std::vector<Basis> cur;
+    bool done;
+    long pruned;                    /* Records skipped as reorderings of others. */
+};
+
+struct Generation_context;
+
+int CreateSubs(Generation_context &Ctx, const std::vector<std::vector<Basis> > &Substitutions, int Begin, int End);
+int CreateMultilinearSubs(Generation_context &Ctx, const std::vector<std::vector<Basis> > &Substitutions);
 
 #endif
@@ -11,12 +11,18 @@
 /***                       to type Term *                        ***/
 /***  PUBLIC ROUTINES:                                           ***/
 /***                     SparseExtractMatrix()                   ***/
+/***                     CommitExtraction()                      ***/
 /***  PRIVATE ROUTINES:                                          ***/
 /***                     SparseFillDependent()                   ***/
 /***                     SparseProcessDependentBasis()           ***/
+/***                     ProcessIndependentBasis()               ***/
+/***                     ProcessOtherIndependentBasis()          ***/
+/***                     NewBasis()                              ***/
+/***                     ClearExtraction()                       ***/
 /***  MODULE DESCRIPTION:                                        ***/
 /*******************************************************************/
 
+#include <algorithm>
 #include <list>
 #include <vector>
 
@@ -35,68 +41,163 @@ using namespace std;
 #include "SparseReduceMatrix.h"
 #include "Type_table.h"
 
-static void SparseFillDependent(const SparseMatrix &SM, vector<int> &Dependent);
+static void SparseFillDependent(const SparseMatrix &SM, int Rank, vector<int> &Dependent);
 #if 0
 static void PrintDependent(void);
 #endif
-static void ProcessIndependentBasis(const vector<int> &Dependent, const vector<Unique_basis_pair> &ColtoBP, vector<Basis> &BasisNames);
-static void SparseProcessDependentBasis(const SparseMatrix &SM, const vector<Unique_basis_pair> &ColtoBP, vector<Basis> &BasisNames);
-static void ProcessOtherIndependentBasis(const vector<Unique_basis_pair> &ColtoBP, int J);
-
-static Type Cur_type;
-static Type T1;
-static Type T2;
-static int Cur_type_degree;
-static int Cur_type_len;
-static int Num_cols;
-static int MatrixRank;
+static void ProcessIndependentBasis(const vector<int> &Dependent, const vector<Unique_basis_pair> &ColtoBP, vector<Basis> &BasisNames, Extraction &E);
+static void SparseProcessDependentBasis(const SparseMatrix &SM, int Rank, const vector<Unique_basis_pair> &ColtoBP, const vector<Basis> &BasisNames, Extraction &E);
+static void ProcessOtherIndependentBasis(const vector<Unique_basis_pair> &ColtoBP, const Packed_type &Cur_type, Packed_type T1, int J, Extraction &E);
+static Basis NewBasis(Basis B1, Basis B2, Extraction &E);
+static void ClearExtraction(Extraction &E);
+
+/* Where a product goes in the Mult table: block by block, in cell order. */
+struct Product_key {
+    Name left_type;
+    Name right_type;
+    Basis left_basis;
+    Basis right_basis;
+    int index;
+
+    bool operator<(const Product_key &k) const {
+        if (left_type != k.left_type)
+            return left_type < k.left_type;
+        if (right_type != k.right_type)
+            return right_type < k.right_type;
+        if (left_basis != k.left_basis)
+            return left_basis < k.left_basis;
+        return right_basis < k.right_basis;
+    }
+};
 
 /* Added (8/92) by DCL. This is virtually identical to ExtractFromMatrix()
    except for the calls to SparseFillDependent() and SparseProcessDependent-
    Basis(). Operation are performed on a locally visible pointer to the 
    matrix and then that pointer is copied to the one passed in upon exit */
    
-int SparseExtractFromMatrix(const SparseMatrix &SM, int Cols, int Rank, Name N, const vector<Unique_basis_pair> &ColtoBP)
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     E -- receives the new basis elements of type N, numbered    */
+/*          from E.first_basis on, and the products of every       */
+/*          basis pair of type N.  Nothing is entered into the     */
+/*          Basis table or the Mult table, so several types may be */
+/*          extracted at once.                                     */
+/*******************************************************************/
+int SparseExtractFromMatrix(const SparseMatrix &SM, int Cols, int Rank, Name N, const vector<Unique_basis_pair> &ColtoBP, Extraction &E)
 {
-    Num_cols = Cols;
-    MatrixRank = Rank;
+    const Packed_type Cur_type = NameToType(N);
+
+    E.name = N;
+    ClearExtraction(E);
 
-    Cur_type_len = GetTargetLen();
-    Cur_type = (Type) Mymalloc(Cur_type_len * sizeof(Degree));
-    assert_not_null(Cur_type);
+    if (Cols > 0 ) {
+        vector<int> Dependent(Cols, 0);
+        vector<Basis> BasisNames(Cols, 0);
 
-    T1 = (Type) Mymalloc((Cur_type_len + 2) * sizeof(Degree)); /* +2 to avoid buffer overflow */
-    assert_not_null(T1);
+        SparseFillDependent(SM, Rank, Dependent);
+        ProcessIndependentBasis(Dependent, ColtoBP, BasisNames, E);
+        SparseProcessDependentBasis(SM, Rank, ColtoBP, BasisNames, E);
+    }
 
-    NameToType(N,T1);
-    NameToType(N,Cur_type);
+    ProcessOtherIndependentBasis(ColtoBP, Cur_type, Cur_type, 0, E);
 
-    Cur_type_degree = GetDegree(Cur_type);
-    T2 = (Type) Mymalloc(Cur_type_len * sizeof(Degree));
-    assert_not_null(T2);
+    return(OK);
+}
 
-    if (Num_cols > 0 ) {
-        vector<int> Dependent(Num_cols, 0);
-        vector<Basis> BasisNames(Num_cols, 0);
 
-        SparseFillDependent(SM, Dependent);
-        ProcessIndependentBasis(Dependent, ColtoBP, BasisNames);
-        SparseProcessDependentBasis(SM, ColtoBP, BasisNames);
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Basis table -- the new basis elements of E are entered.     */
+/*     Type table -- the basis range of E.name is entered.         */
+/*     Mult table -- the products of E are entered.                */
+/*     E -- emptied.                                               */
+/* REQUIRES:                                                       */
+/*     E.first_basis is the next basis element to be filled.       */
+/* RETURNS:                                                        */
+/*     1 if successfull, 0 otherwise.                              */
+/*******************************************************************/
+int CommitExtraction(Extraction &E)
+{
+    if (GetNextBasisTobeFilled() != E.first_basis) {
+        printf("Basis elements of a type committed out of order.\n");
+        return(0);
     }
 
-    ProcessOtherIndependentBasis(ColtoBP, 0);
+    for (int i=0; i<(int)E.factors.size(); i++)
+        EnterBasis(E.factors[i].left_basis, E.factors[i].right_basis, E.name);
+    IndexBasisFactors();
+
+    if (E.factors.empty())
+        UpdateTypeTable(E.name,0,0);    /* No Basis table entries. */
+    else
+        UpdateTypeTable(E.name, E.first_basis, E.first_basis + E.factors.size() - 1);
+
+    /* The Mult table takes the products block by block, each in order. */
+    const int n = E.product_pairs.size();
+    vector<Product_key> keys(n);
+#pragma omp parallel for schedule(static)
+    for (int i=0; i<n; i++) {
+        keys[i].left_basis = E.product_pairs[i].left_basis;
+        keys[i].right_basis = E.product_pairs[i].right_basis;
+        keys[i].left_type = GetType(keys[i].left_basis);
+        keys[i].right_type = GetType(keys[i].right_basis);
+        keys[i].index = i;
+    }
+    sort(keys.begin(), keys.end());
+
+    ReserveProducts(E.product_terms.size());
+    for (int i=0; i<n; i++) {
+        const int k = keys[i].index;
+        const unsigned begin = E.product_begin[k];
+        EnterProduct(keys[i].left_basis, keys[i].right_basis,
+                     E.product_terms.data() + begin, E.product_begin[k + 1] - begin);
+    }
 
-    free(Cur_type);
-    free(T1);
-    free(T2);
+    vector<Unique_basis_pair>().swap(E.factors);
+    vector<Unique_basis_pair>().swap(E.product_pairs);
+    vector<unsigned>(1, 0).swap(E.product_begin);
+    vector<pair<Basis, Scalar> >().swap(E.product_terms);
 
     return(OK);
 }
 
 
-void SparseFillDependent(const SparseMatrix &SM, vector<int> &Dependent)
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     E -- left with no basis elements and no products.           */
+/*******************************************************************/
+void ClearExtraction(Extraction &E)
 {
-    if (SM.empty() || (Num_cols == 0))
+    E.factors.clear();
+    E.product_pairs.clear();
+    E.product_begin.assign(1, 0);
+    E.product_terms.clear();
+}
+
+
+/*
+ * Returns the number of the new basis element B1*B2 and records the
+ * product B1*B2 = it.
+ */
+Basis NewBasis(Basis B1, Basis B2, Extraction &E)
+{
+    const Basis n = E.first_basis + E.factors.size();
+
+    Unique_basis_pair bp;
+    bp.left_basis = B1;
+    bp.right_basis = B2;
+    E.factors.push_back(bp);
+    E.product_pairs.push_back(bp);
+    E.product_terms.push_back(make_pair(n, S_one()));
+    E.product_begin.push_back(E.product_terms.size());
+
+    return n;
+}
+
+
+void SparseFillDependent(const SparseMatrix &SM, int Rank, vector<int> &Dependent)
+{
+    if (SM.empty() || Dependent.empty())
         return;
 
          /* This routine is much simpler than its sister FillDependent()
@@ -104,7 +205,7 @@ void SparseFillDependent(const SparseMatrix &SM, vector<int> &Dependent)
             the first nonzero element */
 
              /* place ones in the correct columns of the Dependent structure */
-    for(int i=0; i < MatrixRank; i++)
+    for(int i=0; i < Rank; i++)
 	 {
 
              Dependent[SM[i].begin()->getColumn()] = S_one();
@@ -128,22 +229,11 @@ void PrintDependent(void)
 #endif
 
 
-void ProcessIndependentBasis(const vector<int> &Dependent, const vector<Unique_basis_pair> &ColtoBP, vector<Basis> &BasisNames)
+void ProcessIndependentBasis(const vector<int> &Dependent, const vector<Unique_basis_pair> &ColtoBP, vector<Basis> &BasisNames, Extraction &E)
 {
-    if (Num_cols == 0)
-        return;
-
-    vector<pair<Basis, Scalar> > tl(1);
-
-    for (int j=0;j<Num_cols;j++) {
-        if (!Dependent[j]) {
-            Basis b1 = ColtoBP[j].left_basis;
-            Basis b2 = ColtoBP[j].right_basis;
-            Basis n = EnterBasis(b1,b2,TypeToName(Cur_type));
-            tl[0] = make_pair(n, 1);
-            EnterProduct(b1, b2, tl);
-            BasisNames[j] = n;
-        }
+    for (int j=0;j<(int)Dependent.size();j++) {
+        if (!Dependent[j])
+            BasisNames[j] = NewBasis(ColtoBP[j].left_basis, ColtoBP[j].right_basis, E);
     }
 }
 
@@ -152,65 +242,59 @@ void ProcessIndependentBasis(const vector<int> &Dependent, const vector<Unique_b
    ProcessDependentBasis except we get the information from the 
    sparse matrix structure. Also we do not use the dependent structure
    since the first element is each linked list representing a row is
-   a nonzero element*/
+   a nonzero element.
+   The products are sized first and then filled in parallel, each row
+   writing straight into its own range of E.product_terms. */
 
-void SparseProcessDependentBasis(const SparseMatrix &SM, const vector<Unique_basis_pair> &ColtoBP, vector<Basis> &BasisNames)
+void SparseProcessDependentBasis(const SparseMatrix &SM, int Rank, const vector<Unique_basis_pair> &ColtoBP, const vector<Basis> &BasisNames, Extraction &E)
 {
-    if (Num_cols == 0)
-        return;
+    const int first = E.product_pairs.size();
 
-    vector<pair<Basis, Scalar> > tl;
+    E.product_pairs.resize(first + Rank);
+    E.product_begin.resize(first + Rank + 1);
+    for(int rowId = 0; rowId < Rank; rowId++)
+        E.product_begin[first + rowId + 1] = E.product_begin[first + rowId] + SM[rowId].size() - 1;
+    E.product_terms.resize(E.product_begin[first + Rank]);
 
-    for(int rowId = 0; rowId < MatrixRank; rowId++) {
+#pragma omp parallel for schedule(dynamic, 64)
+    for(int rowId = 0; rowId < Rank; rowId++) {
        const SparseRow &row = SM[rowId];
+       pair<Basis, Scalar> *t = E.product_terms.data() + E.product_begin[first + rowId];
 
-       tl.clear();
        SparseRow::const_iterator ii = row.begin();
-       for(ii++; ii!=row.end(); ii++) {
-           int k = ii->getColumn();
-	   Scalar S_temp = Get_Matrix_Element(SM, rowId, k);
-           tl.push_back(make_pair(BasisNames[k], S_minus(S_temp)));
-       }
-
-       int j=row.begin()->getColumn();
-       Basis b1 = ColtoBP[j].left_basis;
-       Basis b2 = ColtoBP[j].right_basis;
-       EnterProduct(b1, b2, tl);
+       E.product_pairs[first + rowId] = ColtoBP[ii->getColumn()];
+       for(ii++; ii!=row.end(); ii++)
+           *t++ = make_pair(BasisNames[ii->getColumn()], S_minus(ii->getElement()));
     }
 }
 
-void ProcessOtherIndependentBasis(const vector<Unique_basis_pair> &ColtoBP, int J)
+void ProcessOtherIndependentBasis(const vector<Unique_basis_pair> &ColtoBP, const Packed_type &Cur_type, Packed_type T1, int J, Extraction &E)
 {
-   vector<pair<Basis, Scalar> > tl(1);
+    const int Cur_type_len = GetTargetLen();
 
     if (Cur_type_len == J) {
         int deg = GetDegree(T1);
-        if ((deg > 0) && (deg < Cur_type_degree)) {
-            for (int i=0;i<Cur_type_len;i++)
-                T2[i] = Cur_type[i] - T1[i];
-            const Basis m1 = BeginBasis(TypeToName(T1));
-            const Basis m2 = EndBasis(TypeToName(T1));
-            const Basis n1 = BeginBasis(TypeToName(T2));
-            const Basis n2 = EndBasis(TypeToName(T2));
+        if ((deg > 0) && (deg < GetDegree(Cur_type))) {
+            const Name t1 = TypeToName(T1);
+            const Name t2 = TypeToName(SubtractType(Cur_type, T1));
+            const Basis m1 = BeginBasis(t1);
+            const Basis m2 = EndBasis(t1);
+            const Basis n1 = BeginBasis(t2);
+            const Basis n2 = EndBasis(t2);
             if ((0 < m1) && (m1 <= m2) && (0 < n1) && (n1 <= n2)) {
                 for (int i=m1;i<=m2;i++) {
                     for (int j=n1;j<=n2;j++) {
-                        if (GetCol(ColtoBP, i, j) == -1) {
-                            Basis n = EnterBasis(i,j,TypeToName(Cur_type));
-                            tl[0] = make_pair(n, 1);
-                            EnterProduct(i, j, tl);
-                        }
+                        if (GetCol(ColtoBP, i, j) == -1)
+                            NewBasis(i, j, E);
                     }
                 }
             }
         }
     }
     else {
-        for (int i=0;i<=Cur_type[J];i++) {
-            Degree save = T1[i];
-            T1[J] = i;
-            ProcessOtherIndependentBasis(ColtoBP, J+1);
-            T1[i] = save;
+        for (int i=0;i<=GetLetter(Cur_type, J);i++) {
+            SetLetter(T1, J, i);
+            ProcessOtherIndependentBasis(ColtoBP, Cur_type, T1, J+1, E);
         }
     }
 } 
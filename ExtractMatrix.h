@@ -1,10 +1,30 @@
 #ifndef _EXTRACT_MATRIX_H_
 #define _EXTRACT_MATRIX_H_
 
+#include <vector>
+
 #include "Build_defs.h"
 #include "CreateMatrix.h"
 
-int SparseExtractFromMatrix(const SparseMatrix &SM, int nCols, int Rank, Name N, const std::vector<Unique_basis_pair> &ColtoBP);
+/*
+ * What the reduced matrix of one type adds to the Basis table and the
+ * Mult table.  New basis elements are numbered from first_basis on, so
+ * a type can be extracted before the types ahead of it are committed.
+ * Product i is pairs[i] = the terms product_terms[product_begin[i] ..
+ * product_begin[i+1]-1].
+ */
+struct Extraction {
+    Extraction() : name(0), first_basis(0), factors(), product_pairs(), product_begin(1, 0), product_terms() {}
 
-#endif
+    Name name;
+    Basis first_basis;
+    std::vector<Unique_basis_pair> factors;     /* Of each new basis element. */
+    std::vector<Unique_basis_pair> product_pairs;
+    std::vector<unsigned> product_begin;
+    std::vector<std::pair<Basis, Scalar> > product_terms;
+};
 
+int SparseExtractFromMatrix(const SparseMatrix &SM, int nCols, int Rank, Name N, const std::vector<Unique_basis_pair> &ColtoBP, Extraction &E);
+int CommitExtraction(Extraction &E);
+
+#endif
@@ -5,8 +5,8 @@
 /***  MODIFICATION:  10/93 - Trent Whiteley                        ***/
 /***                        changes to allow for interrupt handler ***/
 /***  PUBLIC ROUTINES:                                             ***/
+/***      Generation_context::Generation_context()                 ***/
 /***      int GenerateEquations()                                  ***/
-/***      int GetVarNumber()                                       ***/
 /***      Eqn_list_node *GetNewEqnListNode()                       ***/
 /***      int FreeEqns()                                           ***/
 /***      int PrintEqns()                                          ***/
@@ -88,80 +88,56 @@ using std::vector;
 #include "Debug.h"
 #include "Type_table.h"
 
-static bool GenerateSeqSubtypes(int Cur_row, int Cur_col, int Weight, Equations &equations);
+static bool GenerateSeqSubtypes(Generation_context &Ctx, int Cur_row, int Cur_col, int Weight);
 #if DEBUG_SEQ_SUBTYPES
-static void PrintSeqSubtypes(void);
+static void PrintSeqSubtypes(const Generation_context &Ctx);
 #endif
 #if 0
 static void PrintEqns(const Equations &equations);
 static void PrintEqn(Basis_pair *Temp_eqn);
 #endif
 
-static Type Target_type = NULL;
-static int Target_type_len = 0;
-static int Target_type_deg = 0;
-static int Num_vars = 0;
-static Type Seq_sub_types = NULL;
-static int *Deg_vars = NULL;
-static int *Cur_deg_vars = NULL;
-static int Whatsleft = 0;
-static const struct polynomial *The_ident = NULL;
-
 extern int sigIntFlag;		/* TW 10/8/93 - flag for Ctrl-C */
 
-int GenerateEquations(const struct polynomial *F, Name N, Equations &equations)
+Generation_context::Generation_context(const Identity_dag &F, Name N, Matrix_builder &Builder)
+  : dag(F), builder(Builder), equations(), status(OK),
+    target_type(NameToType(N)), target_type_len(GetTargetLen()), num_vars(0),
+    deg_vars(), cur_deg_vars(), seq_sub_types(), whatsleft(GetDegreeName(N)),
+    max_deg_var(0), permutations(), subs_batch_size(0), pruned_substitutions(0),
+    pruned_permutations(0), memo_hits(0), memo_lookups(0), memo_saved(0)
 {
-    int i,j;
-
-    The_ident = F;
-
-    Target_type_len = GetTargetLen(); 
-    Target_type_deg = GetDegreeName(N);
-
-    Num_vars = 0;
-    for (i=0;i<NUM_LETTERS;i++)
-        if (The_ident->deg_letter[i] > 0)
-            Num_vars++;
-
-    Target_type = GetNewType(); 
-    assert_not_null(Target_type);
-
-    Seq_sub_types = (Type) (Mymalloc(Num_vars * Target_type_len * sizeof(Degree)));
-    assert_not_null(Seq_sub_types);
-
-    Deg_vars = (int *) (Mymalloc(Num_vars * sizeof(int)));
-    assert_not_null(Deg_vars);
-
-    Cur_deg_vars = (int *) (Mymalloc(Num_vars * sizeof(int)));
-    assert_not_null(Cur_deg_vars);
-
-    NameToType(N,Target_type);
+    for (int i=0;i<NUM_LETTERS;i++)
+        if (dag.DegLetter(i) > 0)
+            deg_vars.push_back(dag.DegLetter(i));
+    num_vars = deg_vars.size();
 
-    for (i=0,j=0;i<NUM_LETTERS;i++)
-        if (The_ident->deg_letter[i] > 0)
-            Deg_vars[j++] = The_ident->deg_letter[i];
-
-    Whatsleft = Target_type_deg;
+    cur_deg_vars.resize(num_vars, 0);
+    seq_sub_types.resize(num_vars, ZeroType());
+}
 
-    memset(Cur_deg_vars, 0, sizeof(Cur_deg_vars[0]) * Num_vars);
-    memset(Seq_sub_types, 0, sizeof(Seq_sub_types[0]) * Num_vars * Target_type_len);
 
-    bool status = GenerateSeqSubtypes(0,0,0, equations); /* Starting of deep recursive calls */
+int GenerateEquations(Generation_context &Ctx)
+{
+    bool status = GenerateSeqSubtypes(Ctx, 0,0,0); /* Starting of deep recursive calls */
 
-    free(Seq_sub_types); Seq_sub_types = NULL;
-    free(Deg_vars); Deg_vars = NULL;
-    free(Cur_deg_vars); Cur_deg_vars = NULL;
-    free(Target_type); Target_type = NULL;
+    if (status)
+        status = Ctx.builder.Flush(Ctx.equations, true) == OK;
 
     return(status);
 }
 
 
-bool GenerateSeqSubtypes(int Cur_row, int Cur_col, int Weight, Equations &equations)
+bool GenerateSeqSubtypes(Generation_context &Ctx, int Cur_row, int Cur_col, int Weight)
 {
 #if DEBUG_SEQ_SUBTYPES
     static int count = 1;
 #endif
+    const int Target_type_len = Ctx.target_type_len;
+    const int Num_vars = Ctx.num_vars;
+    const Packed_type &Target_type = Ctx.target_type;
+    const int *Deg_vars = &Ctx.deg_vars[0];
+    int *Cur_deg_vars = &Ctx.cur_deg_vars[0];
+    Packed_type *Seq_sub_types = &Ctx.seq_sub_types[0];
 
     if(sigIntFlag == 1){     /* TW 10/5/93 - Ctrl-C check */
       return false;
@@ -170,52 +146,52 @@ bool GenerateSeqSubtypes(int Cur_row, int Cur_col, int Weight, Equations &equati
     if (Cur_col == Target_type_len) {
 #if DEBUG_SEQ_SUBTYPES
         printf("Printing %d th SeqSubtypes \n",count++);
-        PrintSeqSubtypes();
+        PrintSeqSubtypes(Ctx);
 #endif
-	bool rv = PerformMultiplePartition(The_ident, equations, Num_vars, Seq_sub_types, Deg_vars);
+	bool rv = PerformMultiplePartition(Ctx) == OK;
         return rv;
     }
     else if (Cur_row == (Num_vars - 1)) {
-        if ((Cur_deg_vars[Cur_row] + Whatsleft) >= Deg_vars[Cur_row]) {
+        if ((Cur_deg_vars[Cur_row] + Ctx.whatsleft) >= Deg_vars[Cur_row]) {
             int csave = Cur_deg_vars[Cur_row];
-            int whatsave = Whatsleft;
-            int tsave = Seq_sub_types[Cur_row*Target_type_len + Cur_col]; 
+            int whatsave = Ctx.whatsleft;
+            int tsave = GetLetter(Seq_sub_types[Cur_row], Cur_col);
 
-            Seq_sub_types[Cur_row*Target_type_len + Cur_col] = Target_type[Cur_col] - Weight;
-            Cur_deg_vars[Cur_row] += Seq_sub_types[Cur_row*Target_type_len + Cur_col];
-            Whatsleft -= Seq_sub_types[Cur_row*Target_type_len + Cur_col];
+            SetLetter(Seq_sub_types[Cur_row], Cur_col, GetLetter(Target_type, Cur_col) - Weight);
+            Cur_deg_vars[Cur_row] += GetLetter(Seq_sub_types[Cur_row], Cur_col);
+            Ctx.whatsleft -= GetLetter(Seq_sub_types[Cur_row], Cur_col);
 
             if ((Cur_col < (Target_type_len - 1)) ||
                ((Cur_col == (Target_type_len - 1)) && 
                (Cur_deg_vars[Cur_row] >= Deg_vars[Cur_row]))){
-                 if(!GenerateSeqSubtypes(0,Cur_col+1,0, equations)) return false;
+                 if(!GenerateSeqSubtypes(Ctx, 0,Cur_col+1,0)) return false;
 	    }
 
             Cur_deg_vars[Cur_row] = csave; 
-            Whatsleft = whatsave;
-            Seq_sub_types[Cur_row*Target_type_len + Cur_col] = tsave; 
+            Ctx.whatsleft = whatsave;
+            SetLetter(Seq_sub_types[Cur_row], Cur_col, tsave);
         }
     }
     else {
-        if ((Cur_deg_vars[Cur_row] + Whatsleft) >= Deg_vars[Cur_row]) {
-            for(int i=Target_type[Cur_col] - Weight;i>=0;i--) {
+        if ((Cur_deg_vars[Cur_row] + Ctx.whatsleft) >= Deg_vars[Cur_row]) {
+            for(int i=GetLetter(Target_type, Cur_col) - Weight;i>=0;i--) {
                 int csave = Cur_deg_vars[Cur_row];
-                int whatsave = Whatsleft;
-                int tsave = Seq_sub_types[Cur_row*Target_type_len + Cur_col]; 
+                int whatsave = Ctx.whatsleft;
+                int tsave = GetLetter(Seq_sub_types[Cur_row], Cur_col);
 
-                Seq_sub_types[Cur_row*Target_type_len + Cur_col] = i; 
+                SetLetter(Seq_sub_types[Cur_row], Cur_col, i);
                 Cur_deg_vars[Cur_row] += i; 
-                Whatsleft -= i; 
+                Ctx.whatsleft -= i; 
                 
                 if ((Cur_col < (Target_type_len - 1)) ||
                    ((Cur_col == (Target_type_len - 1)) && 
                    (Cur_deg_vars[Cur_row] >= Deg_vars[Cur_row]))){
-                     if(!GenerateSeqSubtypes(Cur_row+1,Cur_col,Weight+i, equations)) return false;
+                     if(!GenerateSeqSubtypes(Ctx, Cur_row+1,Cur_col,Weight+i)) return false;
 		}
 
                 Cur_deg_vars[Cur_row] = csave; 
-                Whatsleft = whatsave;
-                Seq_sub_types[Cur_row*Target_type_len + Cur_col] = tsave; 
+                Ctx.whatsleft = whatsave;
+                SetLetter(Seq_sub_types[Cur_row], Cur_col, tsave);
             }
         }
     }
@@ -224,32 +200,15 @@ bool GenerateSeqSubtypes(int Cur_row, int Cur_col, int Weight, Equations &equati
 }
 
 
-int GetVarNumber(char Letter)
-{
-    int var_num = 1;
-    int i;
-
-    for (i=0;i<NUM_LETTERS;i++) {
-        if ((Letter - 'a') == i)
-            return(var_num);
-        else if (The_ident->deg_letter[i] > 0)
-            var_num++;
-    }
-    printf("warning: GetVarNumber() fall through\n"); 
-    return -1;
-} 
-
 #if DEBUG_SEQ_SUBTYPES
-void PrintSeqSubtypes(void)
+void PrintSeqSubtypes(const Generation_context &Ctx)
 {
-    static int count = 1;
-
     int i,j;
 
-    for (i=0;i<Num_vars;i++) {
+    for (i=0;i<Ctx.num_vars;i++) {
         printf("    ");
-        for (j=0;j<Target_type_len;j++)
-            printf("%d",Seq_sub_types[i*Target_type_len + j]);
+        for (j=0;j<Ctx.target_type_len;j++)
+            printf("%d",GetLetter(Ctx.seq_sub_types[i], j));
         printf("\n");
     }
 }
@@ -5,9 +5,46 @@
 
 #include "Build_defs.h"
 #include "CreateMatrix.h"
+#include "Id_dag.h"
+#include "PerformSub.h"
 #include "Po_parse_exptext.h"
+#include "Type_table.h"
 
-int GenerateEquations(const struct polynomial *F, Name N, Equations &equations);
-int GetVarNumber(char Letter);
+/*
+ * Everything needed to generate the equations of one identity in one
+ * type.  It is passed down through GenerateEquations(),
+ * PerformMultiplePartition(), CreateSubs() and PerformSubs() in place
+ * of file statics, so that several identities can be expanded at once,
+ * each into its own equation buffer.
+ */
+struct Generation_context {
+    Generation_context(const Identity_dag &F, Name N, Matrix_builder &Builder);
+
+    const Identity_dag &dag;
+    Matrix_builder &builder;
+    Equation_buffer equations;
+    int status;
+
+    /* Sequential subtypes. */
+    Packed_type target_type;
+    int target_type_len;
+    int num_vars;
+    std::vector<int> deg_vars;
+    std::vector<int> cur_deg_vars;
+    std::vector<Packed_type> seq_sub_types;     /* One per variable. */
+    int whatsleft;
+
+    /* Set partitions and substitutions. */
+    int max_deg_var;
+    Permutation_space permutations;
+    int subs_batch_size;
+    long pruned_substitutions;      /* Records equivalent to one generated. */
+    long pruned_permutations;       /* Permutations fixing a generated record. */
+    long memo_hits;                 /* Of the memo of MUL results, see PerformSubs(). */
+    long memo_lookups;
+    double memo_saved;              /* Seconds the hits saved. */
+};
+
+int GenerateEquations(Generation_context &Ctx);
 
 #endif
@@ -10,7 +10,7 @@
 /***                                   messages                  ***/
 /*******************************************************************/
 
-#define    NUM_COMMANDS    22
+#define    NUM_COMMANDS    23
 
 static int helpLines = 0;
 static int helpCols = 0;
@@ -31,6 +31,7 @@ static struct Help_struct Help_lines[NUM_COMMANDS] = {
     g -- generators command\n\
     h -- help command\n\
     i -- identity command\n\
+    l -- load command\n\
     o -- output command\n\
     p -- polynomial command\n\
     q -- quit command\n\
@@ -119,12 +120,35 @@ development through helpful discussions.\n\n"
 "\n\n\
 \t\tInvoking Albert\n\n\
 Albert is invoked on the command line by giving its name\n\
-followed by two arguments.\n\n\
-albert -a dirname\n\n\
+followed by optional arguments.\n\n\
+albert -a dirname -m megabytes -o -c -k dirname -K megabytes\n\n\
 The arguments are optional.  Here, dirname refers to the\n\
 directory location where albert will get the \".albert\"\n\
 file.  If this argument is not given, albert will look for\n\
-it in the current directory.\n\n"
+it in the current directory.\n\n\
+During build, equations are turned into matrix rows in\n\
+batches.  The -m argument sets how many megabytes of\n\
+equations may be held before a batch is moved into the\n\
+matrix.  The default is 256.\n\n\
+The -o argument turns on online solving.  Each batch is\n\
+reduced against the rows kept so far as soon as it becomes\n\
+part of the matrix, and only rows giving a new pivot are\n\
+kept.  This bounds the matrix by its rank rather than by\n\
+the number of equations.\n\n\
+The -c argument processes all types of a degree at once,\n\
+largest first, one type per processor.  The results are\n\
+entered in the usual order, so the tables built are the\n\
+same as without -c.  This pays off when a degree has many\n\
+types of similar size.\n\n\
+The -k argument names a directory in which build keeps the\n\
+tables it completes, under a name given by the identities,\n\
+field and problem type up to their degree.  They are kept at\n\
+the end of every degree.  A build with the same ones loads\n\
+the tables instead, and one that agrees with an earlier\n\
+build up to some degree goes on from there.  Any number of\n\
+sessions may share the directory.\n\
+The least recently used tables are removed once it holds\n\
+more than the megabytes given by -K, 1024 by default.\n\n"
 },
 {
     "b",
@@ -135,7 +159,8 @@ algebra defined by the current configuration.  Albert\n\
 constructs the algebra using the current set of identities,\n\
 problem type and field stored in the current configuration.\n\
 Status information is printed during the construction.  An\n\
-old multiplication table is destroyed.\n\n\
+old multiplication table is destroyed.  With a build cache,\n\
+see I, tables already built are loaded from it.\n\n\
 A problem type must have been defined with the generators\n\
 command.  Likely reasons for this command to fail are\n\
 insufficient memory, insufficient time, or exceeding the\n\
@@ -205,6 +230,22 @@ in the \".albert\" file can also be used to enter a\n\
 polynomial.  The entered polynomial must be homogeneous.\n\
 Albert linearizes all identities without telling the user.\n\n"
 },
+{
+    "l",
+"\n\n\
+\t\tload [file]\n\n\
+This command loads the tables written by \"save a\" in place\n\
+of a build, destroying any resident multiplication table.\n\
+If no file is given, the user is prompted for one as with\n\
+the save command.  The file is mapped rather than read, so\n\
+it is ready at once and its pages are shared by every Albert\n\
+that loads it.  The identities, field and problem type of\n\
+the current configuration must be those the tables were\n\
+built with, the identities in any order; otherwise the\n\
+differences are listed and nothing is loaded.  A file that\n\
+is damaged is likewise refused, and in either case the\n\
+resident multiplication table is kept.\n\n"
+},
 {
     "o",
 "\n\n\
@@ -257,7 +298,7 @@ table, if present.\n\n"
 {
     "s",
 "\n\n\
-\t\tsave [b | m]\n\n\
+\t\tsave [b | m | a | c | n]\n\n\
 This command saves the basis table or the multiplication\n\
 table to a file specified by the user, provided the table\n\
 and the file already exist.  After typing the save command,\n\
@@ -271,7 +312,18 @@ For example, typing\n\n\
 \tsave b\n\
 \tFile Name --> Mult.table\n\n\
 will save the current multiplication table in Mult.table in\n\
-the current directory.\n\n"
+the current directory.\n\n\
+The argument \"a\" saves all the tables, type, basis and\n\
+multiplication, in a binary file for the load command.  The\n\
+file records the identities, field and problem type they\n\
+were built with.  Its name may follow, as in\n\n\
+\tsave a alt.tables\n\n\
+The arguments \"c\" and \"n\" export the multiplication\n\
+table for other programs, again with an optional file name.\n\
+\"c\" writes comma separated lines left,right,basis,coef, one\n\
+for each term of each product, with basis and coef 0 for a\n\
+product that is zero.  \"n\" writes the same products as\n\
+binary columns, described in Table_export.cpp.\n\n"
 },
 {
     "t",
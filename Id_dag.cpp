@@ -0,0 +1,160 @@
+/*******************************************************************/
+/***  FILE :        Id_dag.cpp                                   ***/
+/***  PUBLIC ROUTINES:                                           ***/
+/***      Identity_dag::Identity_dag()                           ***/
+/***  PRIVATE ROUTINES:                                          ***/
+/***      int AddNode()                                          ***/
+/***      void AddLeafRegisters()                                ***/
+/***  MODULE DESCRIPTION:                                        ***/
+/***      Compiles an identity into a DAG of its distinct        ***/
+/***      subterms.  Identities written with associators or      ***/
+/***      Jordan products repeat the same subwords in many       ***/
+/***      terms; in the DAG each of them is multiplied out only  ***/
+/***      once per substitution.  The DAG is then laid out as a  ***/
+/***      flat postfix program for the interpreter in            ***/
+/***      PerformSub.cpp.                                        ***/
+/*******************************************************************/
+
+#include <map>
+#include <vector>
+
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::vector;
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Id_dag.h"
+#include "Scalar_arithmetic.h"
+
+typedef map<pair<int, int>, int> Node_index;
+
+static int AddNode(const struct term_node *W, const int *Var_number, vector<Identity_dag::Node> &Nodes, Node_index &Leaves, Node_index &Products, int *Count);
+static void AddLeafRegisters(const vector<Identity_dag::Node> &Nodes, int N, vector<int> &Leaf_registers);
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     F -- identity to compile.                                   */
+/* FUNCTION:                                                       */
+/*     Number the variables of F in alphabetical order, as the     */
+/*     substitution records do, and enter the left and right       */
+/*     subterm of every term of F.  Then write the program.        */
+/*******************************************************************/
+Identity_dag::Identity_dag(const struct polynomial *F)
+  : degree(F->degree), deg_letter(), nodes(), terms(), num_term_nodes(0),
+    program(), leaf_registers()
+{
+    memcpy(deg_letter, F->deg_letter, sizeof(deg_letter));
+
+    int var_number[NUM_LETTERS];
+    int n = 0;
+    for (int i=0; i<NUM_LETTERS; i++)
+        var_number[i] = F->deg_letter[i] > 0 ? n++ : -1;
+
+    Node_index leaves;
+    Node_index products;
+
+    for (const term_head *h = F->terms; h != NULL; h = h->next) {
+        const term_node *W = h->term;
+
+        /* A single letter has no product to enter. */
+        if (W == NULL || W->left == NULL || W->right == NULL)
+            continue;
+
+        Term t;
+        t.coef = ConvertToScalar(h->coef);
+        t.left = AddNode(W->left, var_number, nodes, leaves, products, &num_term_nodes);
+        t.right = AddNode(W->right, var_number, nodes, leaves, products, &num_term_nodes);
+        terms.push_back(t);
+    }
+
+    for (int i=0; i<(int)nodes.size(); i++) {
+        const Node &node = nodes[i];
+        Instruction ins;
+        ins.dst = i;
+        ins.coef = S_zero();
+        ins.leaf_begin = ins.leaf_end = leaf_registers.size();
+        if (node.left < 0) {
+            ins.op = OP_LEAF;
+            ins.a = node.var;
+            ins.b = node.occurrence;
+        } else {
+            ins.op = OP_MUL;
+            ins.a = node.left;
+            ins.b = node.right;
+            /* A product of two leaves is a single table lookup; not worth a memo. */
+            if (nodes[node.left].left >= 0 || nodes[node.right].left >= 0) {
+                AddLeafRegisters(nodes, i, leaf_registers);
+                ins.leaf_end = leaf_registers.size();
+            }
+        }
+        program.push_back(ins);
+    }
+
+    for (int i=0; i<(int)terms.size(); i++) {
+        Instruction ins;
+        ins.op = OP_TERM;
+        ins.dst = -1;
+        ins.a = terms[i].left;
+        ins.b = terms[i].right;
+        ins.coef = terms[i].coef;
+        ins.leaf_begin = ins.leaf_end = 0;
+        program.push_back(ins);
+    }
+}
+
+
+/*
+ * Returns the node of subterm W, entering W and its subterms if they
+ * are new.  Count is incremented for every subterm visited.
+ */
+int AddNode(const struct term_node *W, const int *Var_number, vector<Identity_dag::Node> &Nodes, Node_index &Leaves, Node_index &Products, int *Count)
+{
+    Identity_dag::Node node;
+    Node_index *index;
+    pair<int, int> key;
+
+    (*Count)++;
+
+    if ((W->left == NULL) && (W->right == NULL)) {
+        node.left = -1;
+        node.right = -1;
+        node.var = Var_number[W->letter - 'a'];
+        node.occurrence = W->number - 1;
+        index = &Leaves;
+        key = make_pair(node.var, node.occurrence);
+    } else {
+        node.left = AddNode(W->left, Var_number, Nodes, Leaves, Products, Count);
+        node.right = AddNode(W->right, Var_number, Nodes, Leaves, Products, Count);
+        node.var = -1;
+        node.occurrence = -1;
+        index = &Products;
+        key = make_pair(node.left, node.right);
+    }
+
+    Node_index::const_iterator ii = index->find(key);
+    if (ii != index->end())
+        return ii->second;
+
+    Nodes.push_back(node);
+    (*index)[key] = Nodes.size() - 1;
+
+    return Nodes.size() - 1;
+}
+
+
+/*
+ * Leaf_registers -- the leaves below node N appended, left to right.
+ */
+void AddLeafRegisters(const vector<Identity_dag::Node> &Nodes, int N, vector<int> &Leaf_registers)
+{
+    if (Nodes[N].left < 0) {
+        Leaf_registers.push_back(N);
+    } else {
+        AddLeafRegisters(Nodes, Nodes[N].left, Leaf_registers);
+        AddLeafRegisters(Nodes, Nodes[N].right, Leaf_registers);
+    }
+}
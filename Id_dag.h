@@ -0,0 +1,73 @@
+#ifndef _ID_DAG_H_
+#define _ID_DAG_H_
+
+/*******************************************************************/
+/***  FILE :        Id_dag.h                                     ***/
+/*******************************************************************/
+
+#include <vector>
+
+#include "Build_defs.h"
+#include "Po_parse_exptext.h"
+
+/*
+ * An identity with equal subterms stored once.  Every proper subterm of
+ * the identity's terms becomes a node; nodes appear after their
+ * children, so a node can be evaluated once its children are.  Each
+ * term of the identity is a coefficient times the product of two nodes.
+ *
+ * The DAG is also compiled to a flat program in postfix order.  Node i
+ * is held in register i; a LEAF loads a substituted basis element, a
+ * MUL multiplies two registers and a TERM adds the basis pairs of two
+ * registers to the equation.  The LEAFs and MULs come first, in node
+ * order, followed by the TERMs.
+ */
+class Identity_dag {
+public:
+    enum Opcode { OP_LEAF, OP_MUL, OP_TERM };
+
+    struct Instruction {
+        Opcode op;
+        int dst;                /* LEAF, MUL: register written. */
+        int a;                  /* MUL, TERM: left register; LEAF: variable. */
+        int b;                  /* MUL, TERM: right register; LEAF: occurrence. */
+        Scalar coef;            /* TERM: coefficient. */
+        int leaf_begin;         /* MUL: range of LeafRegisters() below it, */
+        int leaf_end;           /*      empty unless worth a memo. */
+    };
+
+    struct Node {
+        int left;               /* -1 for a leaf. */
+        int right;
+        int var;                /* Leaf: variable number, from 0. */
+        int occurrence;         /* Leaf: occurrence of the variable, from 0. */
+    };
+
+    struct Term {
+        Scalar coef;
+        int left;
+        int right;
+    };
+
+    explicit Identity_dag(const struct polynomial *F);
+
+    int Degree() const { return degree; }
+    int DegLetter(int i) const { return deg_letter[i]; }
+    const std::vector<Node> &Nodes() const { return nodes; }
+    const std::vector<Term> &Terms() const { return terms; }
+    int NumTermNodes() const { return num_term_nodes; }
+    const std::vector<Instruction> &Program() const { return program; }
+    const std::vector<int> &LeafRegisters() const { return leaf_registers; }
+    int NumRegisters() const { return nodes.size(); }
+
+private:
+    int degree;
+    short deg_letter[NUM_LETTERS];
+    std::vector<Node> nodes;
+    std::vector<Term> terms;
+    int num_term_nodes;         /* Subterm occurrences before sharing. */
+    std::vector<Instruction> program;
+    std::vector<int> leaf_registers;
+};
+
+#endif
@@ -12,7 +12,20 @@
 /***      struct id_queue_node *Id_queue_node_alloc()            ***/
 /***      void No_memory_panic()                                 ***/
 /***      void Short_string_panic()                              ***/
+/***      void *PoolAlloc()                                      ***/
+/***      void PoolFree()                                        ***/
+/***      void TrimPools()                                       ***/
+/***      void CheckPools()                                      ***/
+/***      void GetPoolStats()                                    ***/
 /***  PRIVATE ROUTINES:                                          ***/
+/***      Pool_cache &MyPoolCache()                              ***/
+/***      int PoolClass()                                        ***/
+/***      void *PoolMalloc()                                     ***/
+/***      void *RefillPoolCache()                                ***/
+/***      void *PoolAllocFrom()                                  ***/
+/***      void PoolFreeTo()                                      ***/
+/***      void TrimCaches()                                      ***/
+/***      Pool_slab *SlabOf()                                    ***/
 /***  MODULE DESCRIPTION:                                        ***/
 /***      This module contains routines to deal with allocation  ***/
 /***      and freeing memory space.                              ***/ 
@@ -21,10 +34,15 @@
 /***      prompt.                                                ***/
 /*******************************************************************/
 
+#include <algorithm>
+#include <vector>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <setjmp.h>
 
+#include <omp.h>
+
 #include "Memory_routines.h"
 #include "Po_parse_poly.h"
 #include "Po_prod_bst.h"
@@ -37,6 +55,63 @@ static struct unexp_tnode *Free_tnode_queue = NULL;
 static int Num_free_tnodes = 0;
 extern jmp_buf env;
 
+/*
+ * The free lists and counters of one thread.  A block freed by another
+ * thread than the one that allocated it joins the freeing thread's
+ * list, so only the sums of the counters over all threads mean much.
+ */
+struct Pool_cache {
+    Pool_cache() : allocs(0), pooled(0), bytes(0), freed(0)
+    {
+        for (int k=0; k<POOL_CLASSES; k++)
+            free_list[k] = NULL;
+    }
+
+    void *free_list[POOL_CLASSES];
+    long allocs;
+    long pooled;                /* Allocations served from the slabs. */
+    long bytes;                 /* Requested by all allocations. */
+    long freed;                 /* Returned by all frees. */
+};
+
+/* A slab, carved into blocks of a single size class. */
+struct Pool_slab {
+    Pool_slab() : base(NULL), k(0), free_blocks(0) {}
+    Pool_slab(char *Base, int K) : base(Base), k(K), free_blocks(0) {}
+
+    char *base;
+    int k;
+    long free_blocks;           /* Counted by TrimPools(). */
+
+    bool operator<(const Pool_slab &S) const { return base < S.base; }
+};
+
+/* The cache of a thread, in Pool_caches while the thread lives. */
+struct Thread_pool_cache {
+    Thread_pool_cache();
+    ~Thread_pool_cache();
+
+    Pool_cache cache;
+};
+
+static std::vector<Pool_cache *> Pool_caches;   /* Of the live threads. */
+static Pool_cache Retired_pool;     /* Blocks and counters of the threads that exited. */
+static std::vector<Pool_slab> Pool_slabs;
+static long Peak_slabs = 0;
+static void *Pool_reserve = NULL;
+static int Pool_failed = 0;         /* An allocation failed in a parallel region. */
+static thread_local Thread_pool_cache My_pool_cache;
+static thread_local bool Pool_cache_retired = false;
+
+static Pool_cache &MyPoolCache(void);
+static int PoolClass(size_t Bytes);
+static void *PoolMalloc(size_t Bytes);
+static void *RefillPoolCache(Pool_cache &C, int K);
+static void *PoolAllocFrom(Pool_cache &C, size_t Bytes);
+static void PoolFreeTo(Pool_cache &C, void *P, size_t Bytes);
+static void TrimCaches(const std::vector<Pool_cache *> &Caches);
+static Pool_slab *SlabOf(void *P);
+
 /*******************************************************************/
 /* MODIFIES: None.                                                 */
 /* REQUIRES:                                                       */
@@ -199,3 +274,332 @@ void No_memory_panic()
     fprintf(stderr,"\nMemory overflow.\n");
     longjmp(env,2);
 }
+
+
+Thread_pool_cache::Thread_pool_cache() : cache()
+{
+#pragma omp critical(pool_slabs)
+    Pool_caches.push_back(&cache);
+}
+
+
+/*
+ * The free blocks and counters of an exiting thread go to
+ * Retired_pool, which serves the thread's last frees from then on.
+ */
+Thread_pool_cache::~Thread_pool_cache()
+{
+#pragma omp critical(pool_retired)
+    {
+#pragma omp critical(pool_slabs)
+        Pool_caches.erase(std::find(Pool_caches.begin(), Pool_caches.end(), &cache));
+
+        for (int k=0; k<POOL_CLASSES; k++) {
+            void **link = &cache.free_list[k];
+            while (*link != NULL)
+                link = (void **) *link;
+            *link = Retired_pool.free_list[k];
+            Retired_pool.free_list[k] = cache.free_list[k];
+        }
+        Retired_pool.allocs += cache.allocs;
+        Retired_pool.pooled += cache.pooled;
+        Retired_pool.bytes += cache.bytes;
+        Retired_pool.freed += cache.freed;
+    }
+    Pool_cache_retired = true;
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     The pool cache of the calling thread, created on first use. */
+/*******************************************************************/
+Pool_cache &MyPoolCache(void)
+{
+    return My_pool_cache.cache;
+}
+
+
+/*
+ * The size class of a block of Bytes <= POOL_MAX_BYTES bytes.
+ */
+int PoolClass(size_t Bytes)
+{
+    if (Bytes <= ((size_t) 1 << POOL_MIN_SHIFT))
+        return 0;
+
+    return 8 * sizeof(unsigned long) - __builtin_clzl(Bytes - 1) - POOL_MIN_SHIFT;
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     Bytes from malloc().                                        */
+/* FUNCTION:                                                       */
+/*     If the system is out, go back to the prompt when outside    */
+/*     parallel regions.  Inside one, give back the reserve so the */
+/*     region can finish, and leave the failure for CheckPools().  */
+/*******************************************************************/
+void *PoolMalloc(size_t Bytes)
+{
+    void *p = malloc(Bytes);
+    if (p != NULL)
+        return p;
+    if (!omp_in_parallel())
+        No_memory_panic();
+
+#pragma omp critical(pool_reserve)
+    {
+        Pool_failed = 1;
+        free(Pool_reserve);
+        Pool_reserve = NULL;
+    }
+    p = malloc(Bytes);
+    if (p == NULL) {
+        fprintf(stderr,"\nMemory overflow beyond the reserve.\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     C -- a new slab carved into its free list of class K.       */
+/* RETURNS:                                                        */
+/*     The head of that free list.                                 */
+/*******************************************************************/
+void *RefillPoolCache(Pool_cache &C, int K)
+{
+    const size_t size = (size_t) 1 << (POOL_MIN_SHIFT + K);
+    char *slab = (char *) PoolMalloc(POOL_SLAB_BYTES);
+
+#pragma omp critical(pool_slabs)
+    {
+        Pool_slabs.push_back(Pool_slab(slab, K));
+        if ((long) Pool_slabs.size() > Peak_slabs)
+            Peak_slabs = Pool_slabs.size();
+    }
+
+    for (size_t off = 0; off + size <= POOL_SLAB_BYTES; off += size) {
+        *(void **) (slab + off) = C.free_list[K];
+        C.free_list[K] = slab + off;
+    }
+
+    return C.free_list[K];
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     A block of at least Bytes bytes, to be returned by          */
+/*     PoolFree() with the same size.                              */
+/*******************************************************************/
+void *PoolAlloc(size_t Bytes)
+{
+    if (Pool_cache_retired) {
+        void *p;
+#pragma omp critical(pool_retired)
+        p = PoolAllocFrom(Retired_pool, Bytes);
+        return p;
+    }
+
+    return PoolAllocFrom(MyPoolCache(), Bytes);
+}
+
+
+/*
+ * PoolAlloc() from the free lists of C.
+ */
+void *PoolAllocFrom(Pool_cache &C, size_t Bytes)
+{
+    C.allocs++;
+    C.bytes += Bytes;
+
+    if (System_allocator || Bytes > POOL_MAX_BYTES)
+        return PoolMalloc(Bytes > 0 ? Bytes : 1);
+
+    const int k = PoolClass(Bytes);
+    void *p = C.free_list[k];
+    if (p == NULL)
+        p = RefillPoolCache(C, k);
+    C.free_list[k] = *(void **) p;
+    C.pooled++;
+
+    return p;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     The calling thread's free list of the class of Bytes -- P   */
+/*     added to it.                                                */
+/*******************************************************************/
+void PoolFree(void *P, size_t Bytes)
+{
+    if (P == NULL)
+        return;
+
+    if (Pool_cache_retired) {
+#pragma omp critical(pool_retired)
+        PoolFreeTo(Retired_pool, P, Bytes);
+        return;
+    }
+
+    PoolFreeTo(MyPoolCache(), P, Bytes);
+}
+
+
+/*
+ * PoolFree() to the free lists of C.
+ */
+void PoolFreeTo(Pool_cache &C, void *P, size_t Bytes)
+{
+    C.freed += Bytes;
+
+    if (System_allocator || Bytes > POOL_MAX_BYTES) {
+        free(P);
+        return;
+    }
+
+    const int k = PoolClass(Bytes);
+    *(void **) P = C.free_list[k];
+    C.free_list[k] = P;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     The pools -- every slab whose blocks are all on the free    */
+/*     lists given back to the system, its blocks taken off them.  */
+/* NOTE:                                                           */
+/*     Must be called outside parallel regions.  Each size class   */
+/*     is trimmed on its own, so blocks still in use only keep     */
+/*     their own slabs.                                            */
+/*******************************************************************/
+void TrimPools(void)
+{
+#pragma omp critical(pool_retired)
+#pragma omp critical(pool_slabs)
+    {
+        std::vector<Pool_cache *> caches(Pool_caches);
+        caches.push_back(&Retired_pool);
+        TrimCaches(caches);
+    }
+}
+
+
+/*
+ * TrimPools() over the free lists of Caches.
+ */
+void TrimCaches(const std::vector<Pool_cache *> &Caches)
+{
+    std::sort(Pool_slabs.begin(), Pool_slabs.end());
+    for (int i=0; i<(int)Pool_slabs.size(); i++)
+        Pool_slabs[i].free_blocks = 0;
+
+    for (int i=0; i<(int)Caches.size(); i++)
+        for (int k=0; k<POOL_CLASSES; k++)
+            for (void *p = Caches[i]->free_list[k]; p != NULL; p = *(void **) p)
+                SlabOf(p)->free_blocks++;
+
+    /* A slab is released when every block carved from it is free. */
+    bool any = false;
+    for (int i=0; i<(int)Pool_slabs.size(); i++) {
+        const long blocks = POOL_SLAB_BYTES >> (POOL_MIN_SHIFT + Pool_slabs[i].k);
+        if (Pool_slabs[i].free_blocks == blocks) {
+            Pool_slabs[i].free_blocks = -1;
+            any = true;
+        }
+    }
+    if (!any)
+        return;
+
+    for (int i=0; i<(int)Caches.size(); i++) {
+        for (int k=0; k<POOL_CLASSES; k++) {
+            void **link = &Caches[i]->free_list[k];
+            while (*link != NULL) {
+                if (SlabOf(*link)->free_blocks < 0)
+                    *link = *(void **) *link;
+                else
+                    link = (void **) *link;
+            }
+        }
+    }
+
+    int kept = 0;
+    for (int i=0; i<(int)Pool_slabs.size(); i++) {
+        if (Pool_slabs[i].free_blocks < 0)
+            free(Pool_slabs[i].base);
+        else
+            Pool_slabs[kept++] = Pool_slabs[i];
+    }
+    Pool_slabs.resize(kept);
+}
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     Pool_slabs -- sorted by address.                            */
+/*     P -- a block carved from one of them.                       */
+/* RETURNS:                                                        */
+/*     Its slab.                                                   */
+/*******************************************************************/
+Pool_slab *SlabOf(void *P)
+{
+    const Pool_slab key((char *) P, 0);
+    std::vector<Pool_slab>::iterator i = std::upper_bound(Pool_slabs.begin(), Pool_slabs.end(), key);
+
+    return &*(i - 1);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     The reserve -- taken again if it was given back.            */
+/* REQUIRES:                                                       */
+/*     Called outside parallel regions, by the thread running the  */
+/*     commands.                                                   */
+/* FUNCTION:                                                       */
+/*     Report an allocation that failed inside a parallel region   */
+/*     since the last call, going back to the prompt.              */
+/*******************************************************************/
+void CheckPools(void)
+{
+    if (Pool_reserve == NULL)
+        Pool_reserve = malloc(POOL_RESERVE_BYTES);
+    if (Pool_failed) {
+        Pool_failed = 0;
+        No_memory_panic();
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     *Allocs -- allocations made so far.                         */
+/*     *Pooled -- of those, the ones served from the slabs.        */
+/*     *Live_MB -- requested and not yet freed.                    */
+/*     *Peak_slab_MB -- most memory held in slabs at once.         */
+/*******************************************************************/
+void GetPoolStats(long *Allocs, long *Pooled, double *Live_MB, double *Peak_slab_MB)
+{
+    long live = 0;
+
+#pragma omp critical(pool_retired)
+#pragma omp critical(pool_slabs)
+    {
+        *Allocs = Retired_pool.allocs;
+        *Pooled = Retired_pool.pooled;
+        live = Retired_pool.bytes - Retired_pool.freed;
+        for (int i=0; i<(int)Pool_caches.size(); i++) {
+            *Allocs += Pool_caches[i]->allocs;
+            *Pooled += Pool_caches[i]->pooled;
+            live += Pool_caches[i]->bytes - Pool_caches[i]->freed;
+        }
+    }
+
+    *Live_MB = live / 1024. / 1024.;
+    *Peak_slab_MB = Peak_slabs * (POOL_SLAB_BYTES / 1024. / 1024.);
+}
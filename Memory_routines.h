@@ -1,6 +1,8 @@
 #ifndef _MEMORY_ROUTINES_H_
 #define _MEMORY_ROUTINES_H_
 
+#include <stddef.h>
+
 #include "Po_prod_bst.h"
 
 struct unexp_tnode *Unexp_tnode_alloc();
@@ -12,4 +14,47 @@ struct term_head *Term_head_alloc();
 void *Mymalloc(int size);
 void No_memory_panic();
 
+/*
+ * Blocks of up to POOL_MAX_BYTES are served from power of two size
+ * classes carved out of slabs.  Each thread keeps its own free lists,
+ * so containers filled and emptied inside parallel regions do not
+ * contend in the system allocator; a thread that exits leaves its
+ * blocks to the others.  With System_allocator set every request goes
+ * to malloc() instead, for comparison.
+ * A worker thread cannot leave its parallel region for the prompt, so
+ * when the system runs out it gives back a reserve of POOL_RESERVE_BYTES
+ * to finish the region on, and CheckPools() reports the failure later.
+ */
+#define POOL_MIN_SHIFT  4                   /* Smallest class: 16 bytes. */
+#define POOL_CLASSES    9                   /* Largest class: 4096 bytes. */
+#define POOL_MAX_BYTES  ((size_t) 1 << (POOL_MIN_SHIFT + POOL_CLASSES - 1))
+#define POOL_SLAB_BYTES (64 * 1024)
+#define POOL_RESERVE_BYTES (64L << 20)
+
+extern int System_allocator;
+
+void *PoolAlloc(size_t Bytes);
+void PoolFree(void *P, size_t Bytes);
+void TrimPools(void);
+void CheckPools(void);
+void GetPoolStats(long *Allocs, long *Pooled, double *Live_MB, double *Peak_slab_MB);
+
+/* STL allocator drawing from the pools. */
+template <class T>
+struct Pool_allocator {
+    typedef T value_type;
+
+    Pool_allocator() {}
+    template <class U> Pool_allocator(const Pool_allocator<U> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(PoolAlloc(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { PoolFree(p, n * sizeof(T)); }
+};
+
+template <class T, class U>
+inline bool operator==(const Pool_allocator<T> &, const Pool_allocator<U> &) { return true; }
+
+template <class T, class U>
+inline bool operator!=(const Pool_allocator<T> &, const Pool_allocator<U> &) { return false; }
+
 #endif
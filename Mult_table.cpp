@@ -10,26 +10,37 @@
 /***                        also added code to support the save, ***/
 /***                        view, and output commands            ***/
 /***  PUBLIC ROUTINES:                                           ***/
-/***      Termptr RetrieveProduct()                              ***/
-/***      int EnterProduct()                                     ***/
-/***      int CreateMultTable()                                  ***/
-/***      int DestroyMultTable()                                 ***/
-/***      Mt_block *Alloc_Mt_block()                             ***/
-/***      Terms_block *Alloc_Terms_block()                       ***/
+/***      void DestroyMultTable()                                ***/
+/***      void ReserveProducts()                                 ***/
+/***      bool EnterProduct()                                    ***/
+/***      const Mt_block *FindBlock()                            ***/
+/***      void CompactMultTable()                                ***/
+/***      void GetMultTableStats()                               ***/
+/***      void GetMultTableArenas()                              ***/
+/***      void MapMultTable()                                    ***/
+/***      void CopyMultTable()                                   ***/
+/***      void PrepareProductAcc()                               ***/
+/***      bool MultTerms()                                       ***/
+/***      void CollectProducts()                                 ***/
+/***      void Print_MultTable()                                 ***/
 /***  PRIVATE ROUTINES:                                          ***/
-/***      int TermsListLength()                                  ***/
-/***      int FreeTermsBlocks()                                  ***/ 
+/***      void SyncArenas()                                      ***/
+/***      void FoldProducts()                                    ***/
 /***  MODULE DESCRIPTION:                                        ***/
-/***      This module contains routines dealing with Algebraic   ***/
-/***      elements.                                              ***/
+/***      This module contains routines dealing with the         ***/
+/***      Multiplication table: a block of products per pair of  ***/
+/***      types, their terms packed into arenas that are built   ***/
+/***      here or mapped from a saved table, see Mult_table.h.   ***/
 /*******************************************************************/
 
+#include <algorithm>
 #include <map>
 #include <vector>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "Mult_table.h"
 #include "Build_defs.h"
@@ -38,13 +49,29 @@
 #include "Memory_routines.h"
 #include "Scalar_arithmetic.h"
 #include "Basis_table.h"
+#include "Table_export.h"
+#include "Type_table.h"
 
 //using std::map;
 using namespace std;
 
-map<pair<Basis, Basis>, vector<pair<Basis, Scalar> > > mult_table;
+map<pair<Name, Name>, Mt_block> mult_table;
+const Scalar *Mt_coefs = NULL;
+const uint16_t *Mt_offsets = NULL;
+const unsigned *Mt_rows = NULL;
+const Mt_word *Mt_words = NULL;
 
-static void Print_AE(const Alg_element &ae, FILE *filePtr);
+/* The arenas while the table is built, or the mapping of a loaded one. */
+static vector<Scalar> Coef_arena;
+static vector<uint16_t> Offset_arena;
+static vector<unsigned> Row_arena;
+static vector<Mt_word> Word_arena;
+static void *Table_map = NULL;
+static size_t Table_map_len = 0;
+static long Mapped_sizes[4];
+
+static void FoldProducts(Product_acc &Acc);
+static void SyncArenas(void);
 
 /*******************************************************************/
 /* MODIFIES: None.                                                 */
@@ -61,66 +88,394 @@ static void Print_AE(const Alg_element &ae, FILE *filePtr);
 void DestroyMultTable(void)
 {
   mult_table.clear();
+  vector<Scalar>().swap(Coef_arena);
+  vector<uint16_t>().swap(Offset_arena);
+  vector<unsigned>().swap(Row_arena);
+  vector<Mt_word>().swap(Word_arena);
+  if (Table_map != NULL) {
+    munmap(Table_map, Table_map_len);
+    Table_map = NULL;
+    Table_map_len = 0;
+  }
+  SyncArenas();
 }
 
 
 /*******************************************************************/
 /* GLOBALS MODIFIED:                                               */
-/*     None.                                                       */
+/*     Mt_coefs, Mt_offsets, Mt_rows, Mt_words -- pointed at the   */
+/*         arenas, which may have moved as they grew.              */
+/*******************************************************************/
+void SyncArenas(void)
+{
+  Mt_coefs = Coef_arena.data();
+  Mt_offsets = Offset_arena.data();
+  Mt_rows = Row_arena.data();
+  Mt_words = Word_arena.data();
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Coef_arena, Offset_arena -- room made for Terms more terms, */
+/*         so the products of a type are entered without growing   */
+/*         the arena.                                              */
+/*******************************************************************/
+void ReserveProducts(long Terms)
+{
+  const size_t need = Coef_arena.size() + Terms;
+  if (Coef_arena.capacity() < need)
+    Coef_arena.reserve(max(need, 2 * Coef_arena.capacity()));
+  if (Offset_arena.capacity() < Offset_arena.size() + Terms)
+    Offset_arena.reserve(max(Offset_arena.size() + Terms, 2 * Offset_arena.capacity()));
+  SyncArenas();
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     mult_table -- B1*B2 = Terms[0 .. Len-1] entered in the      */
+/*                   block of the types of B1 and B2, which is     */
+/*                   created if need be.                           */
+/* REQUIRES:                                                       */
+/*     The products of a block are entered in ascending (B1,B2),   */
+/*     one block after the other, once the Type table holds the    */
+/*     basis range of their type and the Basis table its basis     */
+/*     elements.  The table must not be mapped.                    */
+/* NOTE:                                                           */
+/*     B1*B2 = 1 b_n with B1 and B2 the factors of b_n keeps no    */
+/*     terms, see TrivialProduct().                                */
+/* RETURNS:                                                        */
+/*     true if successfull, false if the product was present or    */
+/*     entered out of order.                                       */
+/*******************************************************************/
+bool EnterProduct(Basis B1, Basis B2, const pair<Basis, Scalar> *Terms, int Len)
+{
+  const Name l = GetType(B1);
+  const Name r = GetType(B2);
+  Mt_block &blk = mult_table[make_pair(l, r)];
+
+  if (blk.rows == 0) {
+    blk.left_begin = BeginBasis(l);
+    blk.right_begin = BeginBasis(r);
+    blk.rows = EndBasis(l) - BeginBasis(l) + 1;
+    blk.cols = EndBasis(r) - BeginBasis(r) + 1;
+    blk.term_begin = Coef_arena.size();
+    blk.row_begin = Row_arena.size();
+    Row_arena.resize(Row_arena.size() + (long) blk.rows * blk.cols + 1, 0);
+    blk.word_begin = Word_arena.size();
+    Word_arena.resize(Word_arena.size() + (long) blk.rows * blk.cols / 64 + 1, 0);
+
+    const Name n = TypeToName(AddType(NameToType(l), NameToType(r)));
+    blk.result_begin = BeginBasis(n);
+    blk.result_end = EndBasis(n);
+    blk.wide = EndBasis(n) - BeginBasis(n) >= 0x10000;
+    blk.shift = (long) Offset_arena.size() - (blk.wide ? 2 : 1) * (long) Coef_arena.size();
+  }
+
+  unsigned *row = &Row_arena[blk.row_begin];
+  Mt_word *words = &Word_arena[blk.word_begin];
+  const long c = (long) (B1 - blk.left_begin) * blk.cols + (B2 - blk.right_begin);
+  const long end = Coef_arena.size() - blk.term_begin;
+  if (c < blk.filled || row[blk.filled] != end) {
+    puts(c < blk.filled && (words[c >> 6] >> (c & 63) & 1) ? "already present" : "product entered out of order");
+    return false;
+  }
+  if (end + Len > (long) UINT32_MAX) {
+    puts("product block of more than 2^32 terms");
+    return false;
+  }
+
+  for (long k = blk.filled; k < c; k++)
+    row[k + 1] = end;
+  blk.filled = c + 1;
+  if (Len == 1 && Terms[0].second == S_one() &&
+      LeftFactor(Terms[0].first) == B1 && RightFactor(Terms[0].first) == B2) {
+    row[c + 1] = end;
+    SyncArenas();
+    return true;
+  }
+
+  for (int k = 0; k < Len; k++) {
+    const Basis off = Terms[k].first - blk.result_begin;
+    Coef_arena.push_back(Terms[k].second);
+    Offset_arena.push_back(off & 0xffff);
+    if (blk.wide)
+      Offset_arena.push_back(off >> 16);
+  }
+  row[c + 1] = Coef_arena.size() - blk.term_begin;
+  words[c >> 6] |= 1ULL << (c & 63);
+  SyncArenas();
+
+  return true;
+}
+
+
+/*******************************************************************/
 /* MODIFIES: None.                                                 */
+/* RETURNS:                                                        */
+/*     The block of products of the types of B1 and B2, NULL if    */
+/*     there is none.                                              */
+/*******************************************************************/
+const Mt_block *FindBlock(Basis B1, Basis B2)
+{
+  map<pair<Name, Name>, Mt_block>::const_iterator ii =
+      mult_table.find(make_pair(GetType(B1), GetType(B2)));
+
+  return (ii == mult_table.end()) ? NULL : &ii->second;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     The arenas -- spare capacity given back.                    */
+/*******************************************************************/
+void CompactMultTable(void)
+{
+  if (Table_map != NULL)
+    return;
+  vector<Scalar>(Coef_arena).swap(Coef_arena);
+  vector<uint16_t>(Offset_arena).swap(Offset_arena);
+  vector<unsigned>(Row_arena).swap(Row_arena);
+  vector<Mt_word>(Word_arena).swap(Word_arena);
+  SyncArenas();
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     *Products, *Terms -- in the table.                          */
+/*     *Implicit -- of the products, those defining a basis        */
+/*                  element, with no terms stored.                 */
+/*     *Bytes -- held by the table, per product.                   */
+/*     *Map_bytes -- per product, as a map from basis pairs to     */
+/*                   vectors of (basis, coef) would hold them.     */
+/*******************************************************************/
+void GetMultTableStats(long *Products, long *Implicit, long *Terms, double *Bytes, double *Map_bytes)
+{
+  const double node = 4 * sizeof(void *);       /* Red-black tree node header. */
+  long coefs, offsets, rows, words;
+  GetMultTableArenas(&coefs, &offsets, &rows, &words);
+  double bytes = coefs * sizeof(Scalar) + offsets * sizeof(uint16_t) +
+                 rows * sizeof(unsigned) + words * sizeof(Mt_word);
+
+  /* Each basis element with factors is one implicit product, indexed
+   * in the Basis table. */
+  *Implicit = 0;
+  for (Basis b = 1; b < GetNextBasisTobeFilled(); b++)
+    *Implicit += LeftFactor(b) != 0;
+  bytes += GetNextBasisTobeFilled() * sizeof(Basis);
+
+  *Products = *Implicit;
+  map<pair<Name, Name>, Mt_block>::const_iterator ii;
+  for (ii = mult_table.begin(); ii != mult_table.end(); ii++) {
+    const Mt_block &blk = ii->second;
+    for (long w = 0; w < (long) blk.rows * blk.cols / 64 + 1; w++)
+      *Products += __builtin_popcountll(Mt_words[blk.word_begin + w]);
+    bytes += node + sizeof(*ii);
+  }
+  *Terms = coefs + *Implicit;
+
+  if (*Products == 0) {
+    *Bytes = *Map_bytes = 0;
+    return;
+  }
+  *Bytes = bytes / *Products;
+  *Map_bytes = node + sizeof(pair<pair<Basis, Basis>, vector<pair<Basis, Scalar> > >) +
+               (double) *Terms * sizeof(pair<Basis, Scalar>) / *Products;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     *Coefs, *Offsets, *Rows, *Words -- entries in each arena.   */
+/*******************************************************************/
+void GetMultTableArenas(long *Coefs, long *Offsets, long *Rows, long *Words)
+{
+  if (Table_map != NULL) {
+    *Coefs = Mapped_sizes[0];
+    *Offsets = Mapped_sizes[1];
+    *Rows = Mapped_sizes[2];
+    *Words = Mapped_sizes[3];
+    return;
+  }
+  *Coefs = Coef_arena.size();
+  *Offsets = Offset_arena.size();
+  *Rows = Row_arena.size();
+  *Words = Word_arena.size();
+}
+
+
+/*******************************************************************/
+/* GLOBALS MODIFIED:                                               */
+/*     Mt_coefs, Mt_offsets, Mt_rows, Mt_words -- pointed into the */
+/*         mapping Map of Len bytes, which DestroyMultTable()      */
+/*         unmaps.                                                 */
 /* REQUIRES:                                                       */
-/*     FILE *filePtr - a ptr to output file, temp file, or stdout  */
-/*     int outputType - output to printer, screen, or a file       */
+/*     The table destroyed, mult_table then filled with the blocks */
+/*     of the mapped arenas.                                       */
+/*******************************************************************/
+void MapMultTable(void *Map, size_t Len, const long Sizes[4], const Scalar *Coefs, const uint16_t *Offsets,
+                  const unsigned *Rows, const Mt_word *Words)
+{
+  Table_map = Map;
+  Table_map_len = Len;
+  for (int i = 0; i < 4; i++)
+    Mapped_sizes[i] = Sizes[i];
+  Mt_coefs = Coefs;
+  Mt_offsets = Offsets;
+  Mt_rows = Rows;
+  Mt_words = Words;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     The arenas -- copies of Coefs, Offsets, Rows and Words, of  */
+/*         Sizes[0 .. 3] entries, that products can be added to.   */
+/* REQUIRES:                                                       */
+/*     As MapMultTable().                                          */
+/*******************************************************************/
+void CopyMultTable(const long Sizes[4], const Scalar *Coefs, const uint16_t *Offsets,
+                   const unsigned *Rows, const Mt_word *Words)
+{
+  Coef_arena.assign(Coefs, Coefs + Sizes[0]);
+  Offset_arena.assign(Offsets, Offsets + Sizes[1]);
+  Row_arena.assign(Rows, Rows + Sizes[2]);
+  Word_arena.assign(Words, Words + Sizes[3]);
+  SyncArenas();
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Acc -- made large enough for every basis element entered so */
+/*            far.  Its sums must be zero.                         */
+/*******************************************************************/
+void PrepareProductAcc(Product_acc &Acc)
+{
+  if (Acc.sum.size() < (size_t) GetNextBasisTobeFilled())
+    Acc.sum.resize(GetNextBasisTobeFilled(), 0);
+  Acc.room = PRODUCT_ACC_ROOM;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Acc -- each sum reduced mod Prime.                          */
+/*******************************************************************/
+void FoldProducts(Product_acc &Acc)
+{
+  for (int i = 0; i < (int) Acc.touched.size(); i++)
+    Acc.sum[Acc.touched[i]] %= Prime;
+  Acc.room = PRODUCT_ACC_ROOM;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Acc -- A * B added to it.                                   */
+/* REQUIRES:                                                       */
+/*     Acc -- prepared by PrepareProductAcc().                     */
 /* RETURNS:                                                        */
-/*     Nothing                                                     */
+/*     true if successfull, false if a product of A and B is not   */
+/*     in the table.  The products that are found are added either */
+/*     way.                                                        */
 /* FUNCTION:                                                       */
-/*     Print the table.                                            */
+/*     The block of a pair of terms is kept while the following    */
+/*     pairs stay in it, so terms of a single type in ascending    */
+/*     order stream their block once.  Nothing is reduced here.    */
 /*******************************************************************/
-void Print_MultTable(FILE *filePtr) /* TW 9/19/93 - added 2 params to support view, save, & output */
+bool MultTerms(const vector<pair<Basis, Scalar> > &A, const vector<pair<Basis, Scalar> > &B, Product_acc &Acc)
 {
-  int i, j, dim;
-  Alg_element prod;
-
-  dim = GetNextBasisTobeFilled();
-  if(dim > 0){
-    fprintf(filePtr, "\nMultiplication table: \n");
-    for (i = 1; i <= dim; i++) {
-      for (j = 1; j <= dim; j++) {
-        prod.clear();
-        Mult2basis(i, j, 1, prod);	/* TW 9/22/93 - change prod[] to *prod */
-        if (!IsZeroAE(prod)) {	/* TW 9/22/93 - change prod[] to *prod */
-          /* PrintBasis(i); */
-          fprintf(filePtr, "(b%d)*(b%d)\n",i,j);
-          /* PrintBasis(j); */
-          Print_AE(prod, filePtr); 	/* TW 9/22/93 - change prod[] to *prod */
-          fprintf(filePtr, "\n\n");
+  bool found = true;
+  const Mt_block *blk = NULL;
+
+  for (vector<pair<Basis, Scalar> >::const_iterator ai = A.begin(); ai != A.end(); ai++) {
+    for (vector<pair<Basis, Scalar> >::const_iterator bi = B.begin(); bi != B.end(); bi++) {
+      if (blk == NULL || !InBlock(*blk, ai->first, bi->first)) {
+        blk = FindBlock(ai->first, bi->first);
+        if (blk == NULL) {
+          found = false;
+          continue;
         }
       }
-    }   
-  }
-}
- 
-void Print_AE(const Alg_element &ae, FILE *filePtr) /* TW 9/19/93 - add 2 params to support view, save, & output */
-{
-  int trmcnt = 0;		/* How many terms have been printed */
-  int lnecnt = 0;		/* How many have been printed on current line */
-
-  map<Basis, Scalar>::const_iterator aei;
-  for(aei = ae.begin(); aei != ae.end(); aei++) {
-    if(aei->first != 0 && aei->second != 0) {
-      int x = aei->second; 
-      if ((trmcnt > 0) && (trmcnt % 4 == 0)) { 		/* 4 items per line */
-        fprintf(filePtr, "\n");	
-        lnecnt = 0;
+      const long c = BlockCell(*blk, ai->first, bi->first);
+      if (c < 0) {
+        const Basis n = TrivialProduct(*blk, ai->first, bi->first);
+        if (n == 0) {
+          found = false;
+          continue;
+        }
+        if (--Acc.room < 0) {
+          FoldProducts(Acc);
+          Acc.room--;
+        }
+        uint32_t &s = Acc.sum[n];
+        if (s == 0)
+          Acc.touched.push_back(n);
+        s += S_mul(ai->second, bi->second);
+        continue;
+      }
+
+      const long begin = blk->term_begin + Mt_rows[blk->row_begin + c];
+      const long end = blk->term_begin + Mt_rows[blk->row_begin + c + 1];
+      const long adds = end - begin;
+      if ((Acc.room -= adds) < 0) {
+        FoldProducts(Acc);
+        Acc.room -= adds;
       }
-      if (lnecnt == 0){
-	fprintf(filePtr, "   %3d b%-4d", x, aei->first);
-      } else{
-        fprintf(filePtr, "+  %3d b%-4d", x, aei->first);
+
+      const uint32_t x = S_mul(ai->second, bi->second);
+      for (long k = begin; k < end; k++) {
+        const Basis w = TermBasis(*blk, k);
+        uint32_t &s = Acc.sum[w];
+        if (s == 0)
+          Acc.touched.push_back(w);
+        s += x * Mt_coefs[k];
       }
-      trmcnt++;
-      lnecnt++;
     }
   }
+
+  return found;
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Ans -- the nonzero sums of Acc, reduced, in the order they  */
+/*            were first touched.                                  */
+/*     Acc -- left with all sums zero.                             */
+/*******************************************************************/
+void CollectProducts(Product_acc &Acc, vector<pair<Basis, Scalar> > &Ans)
+{
+  Ans.clear();
+  for (int i = 0; i < (int) Acc.touched.size(); i++) {
+    uint32_t &s = Acc.sum[Acc.touched[i]];
+    const Scalar x = s % Prime;
+    s = 0;
+    if (x != S_zero())
+      Ans.push_back(make_pair(Acc.touched[i], x));
+  }
+  Acc.touched.clear();
+  Acc.room = PRODUCT_ACC_ROOM;
+}
+
+
+/*******************************************************************/
+/* GLOBALS MODIFIED:                                               */
+/*     None.                                                       */
+/* MODIFIES: None.                                                 */
+/* REQUIRES:                                                       */
+/*     FILE *filePtr - a ptr to output file, temp file, or stdout  */
+/*     int outputType - output to printer, screen, or a file       */
+/* RETURNS:                                                        */
+/*     Nothing                                                     */
+/* FUNCTION:                                                       */
+/*     Print the table, see Table_export.cpp.                      */
+/*******************************************************************/
+void Print_MultTable(FILE *filePtr) /* TW 9/19/93 - added 2 params to support view, save, & output */
+{
+  WriteMultTable(filePtr, EXPORT_TEXT);
 }
 
@@ -13,44 +13,139 @@
 #include <vector>
 #include <map>
 
+#include <stdint.h>
+
 #include "Build_defs.h"
 #include "Alg_elements.h"
+#include "Basis_table.h"
+
+/*
+ * The products of the basis elements of one left type with those of one
+ * right type.  Cell (i - left_begin) * cols + (j - right_begin) holds
+ * the terms of b_i * b_j, terms term_begin + Mt_rows[row_begin + c] ..
+ * term_begin + Mt_rows[row_begin + c + 1] - 1 of the arena.  Row
+ * entries are relative to the block, so the arena may grow past 2^32
+ * terms while a block keeps under it.  Cells are filled in
+ * ascending order and a block's terms are contiguous; cells at or past
+ * filled have no product.  Bit c & 63 of Mt_words[word_begin + (c >> 6)]
+ * is set if cell c is present, its terms in the arena.  A product that
+ * defines a new basis element, b_i * b_j = b_n, is not: its cell holds
+ * no terms and b_n is found from its factors in the Basis table.
+ */
+typedef uint64_t Mt_word;
+
+struct Mt_block {
+    Mt_block() : left_begin(0), right_begin(0), rows(0), cols(0), filled(0), term_begin(0), row_begin(0),
+        word_begin(0), result_begin(0), result_end(0), wide(false), shift(0) {}
+
+    Basis left_begin;
+    Basis right_begin;
+    int rows;
+    int cols;
+    long filled;
+    long term_begin;            /* First term of the block in the arena. */
+    long row_begin;             /* rows * cols + 1 entries of Mt_rows. */
+    long word_begin;            /* One entry of Mt_words per 64 cells. */
+    Basis result_begin;         /* First basis element of the products' type. */
+    Basis result_end;           /* And its last. */
+    bool wide;                  /* Offsets take two entries. */
+    long shift;                 /* Offset of term k at (wide ? 2k : k) + shift. */
+};
+
+/*
+ * The terms of all products, in one arena: Mt_coefs[k] is the
+ * coefficient of term k.  Its basis element is stored as an offset
+ * from the first basis element of the product's type, in one entry of
+ * Mt_offsets, or two (low half first) for a type of more than 2^16
+ * basis elements.  The arenas are either built here or mapped read
+ * only from a saved table, see Table_file.cpp.
+ */
+extern const Scalar *Mt_coefs;
+extern const uint16_t *Mt_offsets;
+extern const unsigned *Mt_rows;
+extern const Mt_word *Mt_words;
+
+extern std::map<std::pair<Name, Name>, Mt_block> mult_table;
 
-extern std::map<std::pair<Basis, Basis>, std::vector<std::pair<Basis, Scalar> > > mult_table;
+/*
+ * Sums of products indexed by basis, left unreduced.  One product adds
+ * less than Prime*Prime < 2^16, so PRODUCT_ACC_ROOM of them fit in 32
+ * bits on top of a reduced sum before the sums must be reduced again.
+ */
+#define PRODUCT_ACC_ROOM 65536
+
+struct Product_acc {
+    Product_acc() : sum(), touched(), room(PRODUCT_ACC_ROOM) {}
+
+    std::vector<uint32_t> sum;
+    std::vector<Basis> touched;     /* Entries of sum that may be nonzero. */
+    long room;
+};
 
 void DestroyMultTable(void);
 void Print_MultTable(FILE *filePtr);
+void ReserveProducts(long Terms);
+bool EnterProduct(Basis B1, Basis B2, const std::pair<Basis, Scalar> *Terms, int Len);
+const Mt_block *FindBlock(Basis B1, Basis B2);
+void PrepareProductAcc(Product_acc &Acc);
+void CompactMultTable(void);
+void GetMultTableStats(long *Products, long *Implicit, long *Terms, double *Bytes, double *Map_bytes);
+void GetMultTableArenas(long *Coefs, long *Offsets, long *Rows, long *Words);
+void MapMultTable(void *Map, size_t Len, const long Sizes[4], const Scalar *Coefs, const uint16_t *Offsets,
+                  const unsigned *Rows, const Mt_word *Words);
+void CopyMultTable(const long Sizes[4], const Scalar *Coefs, const uint16_t *Offsets,
+                   const unsigned *Rows, const Mt_word *Words);
+bool MultTerms(const std::vector<std::pair<Basis, Scalar> > &A, const std::vector<std::pair<Basis, Scalar> > &B, Product_acc &Acc);
+void CollectProducts(Product_acc &Acc, std::vector<std::pair<Basis, Scalar> > &Ans);
 
-inline bool EnterProduct(Basis B1, Basis B2, const std::vector<std::pair<Basis, Scalar> > &tl)
+inline bool InBlock(const Mt_block &Blk, Basis B1, Basis B2)
 {
-  const std::pair<Basis, Basis> bb = std::make_pair(B1, B2);
+  return (unsigned) (B1 - Blk.left_begin) < (unsigned) Blk.rows &&
+         (unsigned) (B2 - Blk.right_begin) < (unsigned) Blk.cols;
+}
 
-  if(mult_table.find(bb) == mult_table.end()) {
-    mult_table[bb] = tl;
-  } else {
-    puts("already present");
-  }
+/* Cell C of Blk, or -1 if the product has no terms in the table. */
+inline long BlockCell(const Mt_block &Blk, Basis B1, Basis B2)
+{
+  const long c = (long) (B1 - Blk.left_begin) * Blk.cols + (B2 - Blk.right_begin);
+  return (c < Blk.filled && (Mt_words[Blk.word_begin + (c >> 6)] >> (c & 63) & 1)) ? c : -1;
+}
 
-  return true;
+/* b_n if b_i * b_j = b_n defines b_n, of Blk's product type, else 0. */
+inline Basis TrivialProduct(const Mt_block &Blk, Basis B1, Basis B2)
+{
+  return FactorBasis(B1, B2, Blk.result_begin, Blk.result_end);
 }
 
-inline bool Mult2basis(Basis B1, Basis B2, Scalar x, Alg_element &P)
+/* The basis element of term K of the arena, one of Blk's. */
+inline Basis TermBasis(const Mt_block &Blk, long K)
 {
-  const std::pair<Basis, Basis> bb = std::make_pair(B1, B2);
+  if (!Blk.wide)
+    return Blk.result_begin + Mt_offsets[K + Blk.shift];
+
+  const long i = 2 * K + Blk.shift;
+  return Blk.result_begin + (Mt_offsets[i] | (Basis) Mt_offsets[i + 1] << 16);
+}
 
-  std::map<std::pair<Basis, Basis>, std::vector<std::pair<Basis, Scalar> > >::const_iterator ii = mult_table.find(bb);
-  if(ii == mult_table.end()) {
+inline bool Mult2basis(Basis B1, Basis B2, Scalar x, Alg_element &P)
+{
+  const Mt_block *blk = FindBlock(B1, B2);
+  if (blk == NULL)
     return false;
-  }
 
-  std::vector<std::pair<Basis, Scalar> >::const_iterator jj;
-  for(jj = ii->second.begin(); jj != ii->second.end(); jj++) {
-    const Basis w = jj->first;
-    const Scalar coef = jj->second;
-    SetAE(P, w, S_add(GetAE(P, w), S_mul(x, coef)));
-    //AccumAE(P, w, S_mul(x, coef));
+  const long c = BlockCell(*blk, B1, B2);
+  if (c < 0) {
+    const Basis n = TrivialProduct(*blk, B1, B2);
+    if (n == 0)
+      return false;
+    AccumAE(P, n, x);
+    return true;
   }
 
+  const unsigned *row = Mt_rows + blk->row_begin + c;
+  for (long k = blk->term_begin + row[0]; k < blk->term_begin + row[1]; k++)
+    AccumAE(P, TermBasis(*blk, k), S_mul(x, Mt_coefs[k]));
+
   return true;
 }
 
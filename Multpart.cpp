@@ -7,12 +7,15 @@
 /***                         handler and modify PrintTypeName()    ***/
 /***  PUBLIC ROUTINES:                                             ***/
 /***      int PerformMultiplePartition()                           ***/
+/***      void ResetEnumerationCache()                             ***/
+/***      void GetEnumerationCacheStats()                          ***/
 /***  PRIVATE ROUTINES:                                            ***/
 /***      int SplitJthType()                                       ***/
 /***      int Gen()                                                ***/
 /***      int AddSetPartition()                                    ***/
 /***      int DeleteSetPartition()                                 ***/
-/***      int OKSetPartition()                                     ***/
+/***      int PerformMultilinearSubstitution()                     ***/
+/***      Enumeration *LookupEnumeration()                         ***/
 /***  MODULE DESCRIPTION:                                          ***/
 /***      The idea of set partitioning is to linearize the         ***/ 
 /***      identity.                                                ***/ 
@@ -62,9 +65,14 @@
 /*********************************************************************/
 
 #include <vector>
+#include <map>
+#include <utility>
 #include <algorithm>
 
 using std::vector;
+using std::map;
+using std::pair;
+using std::make_pair;
 using std::max_element;
 
 #include <stdio.h>
@@ -73,53 +81,69 @@ using std::max_element;
 #include "Multpart.h"
 #include "Build_defs.h"
 #include "CreateSubs.h"
+#include "GenerateEquations.h"
+#include "PerformSub.h"
 #include "Type_table.h"
 #include "CreateMatrix.h"
 #include "Memory_routines.h"
 #include "Po_parse_exptext.h"
 #include "Debug.h"
 
-static void SplitJthType(const vector<Name> &Var_types, int j, vector<Name> &Set_partitions, vector<int> &Cur_index_var, vector<vector<Basis> > &all_Substitutions);
-static void Gen(const vector<Name> &Var_types, Name n, int d, int j, vector<Name> &Set_partitions, vector<int> &Cur_index_var, vector<vector<Basis> > &all_Substitutions);
+/*
+ * The set partitions of some variable types, in the order
+ * SplitJthType() finds them, each max_deg_var * nVars names laid out
+ * as Set_partitions.  They depend only on the degrees and types of the
+ * variables, so identities with the same ones share them.  Their
+ * substitution records are not kept: they are generated again, a batch
+ * at a time, for every identity.
+ */
+struct Enumeration {
+    Enumeration() : partitions(), bytes(0) {}
+
+    vector<Name> partitions;
+    long bytes;
+};
+
+typedef pair<vector<int>, vector<Name> > Enumeration_key;     /* Deg_var, Var_types. */
+
+static map<Enumeration_key, Enumeration> Enumeration_cache;
+static long Enumeration_hits = 0;
+static long Enumeration_lookups = 0;
+static long Enumeration_bytes = 0;
+
+static int PerformMultilinearSubstitution(Generation_context &Ctx, const vector<Name> &Var_types);
+static const Enumeration *LookupEnumeration(Generation_context &Ctx, const vector<Name> &Var_types, Enumeration &Uncached);
+static void SplitJthType(Generation_context &Ctx, const vector<Name> &Var_types, int j, vector<Name> &Set_partitions, vector<int> &Cur_index_var, Enumeration &E);
+static void Gen(Generation_context &Ctx, const vector<Name> &Var_types, Name n, int d, int j, Name Max_name, vector<Name> &Set_partitions, vector<int> &Cur_index_var, Enumeration &E);
 static void AddSetPartition(int nVars, Name n, int j, vector<Name> &Set_partitions, vector<int> &Cur_index_var);
 static void DeleteSetPartition(Name j, vector<int> &Cur_index_var);
-static int OKSetPartitions(int nVars, const vector<Name> &Set_partitions);
 #if DEBUG_SET_PARTITIONS
-static void PrintVarTypes(void);
-static void PrintSetPartitions(void);
+static void PrintVarTypes(const vector<Name> &Var_types);
+static void PrintSetPartitions(const Generation_context &Ctx, const vector<Name> &Set_partitions);
 #endif
 
-static const int *Deg_var_types = NULL;
-
-static int Max_deg_var = 0;
-static int status = OK;
-
 extern int sigIntFlag;		/* TW 10/8/93 - flag for Ctrl-C */
 
 
-int PerformMultiplePartition(const struct polynomial *The_ident, Equations &equations, int nVars, Type Types, const int *Deg_var)
+int PerformMultiplePartition(Generation_context &Ctx)
 {
-    Deg_var_types = Deg_var;
+    const int nVars = Ctx.num_vars;
+    const int *Deg_var_types = &Ctx.deg_vars[0];
 
-    status = OK;
+    Ctx.status = OK;
 
     vector<Name> Var_types(nVars);
-    {
-        int target_type_len = GetTargetLen();
+    for (int i=0;i<nVars;i++)
+        Var_types[i] = TypeToName(Ctx.seq_sub_types[i]);
 
-        for (int i=0;i<nVars;i++) {
-            Var_types[i] = TypeToName(&Types[i*target_type_len + 0]);
-        }
-    }
-
-    Max_deg_var = *max_element(Deg_var_types, Deg_var_types + nVars);
+    Ctx.max_deg_var = *max_element(Deg_var_types, Deg_var_types + nVars);
 
 #if 0
-printf("mp: %d %d %d %d\n", nVars, NUM_LETTERS, target_type_len, Max_deg_var);
+printf("mp: %d %d %d %d\n", nVars, NUM_LETTERS, Ctx.target_type_len, Ctx.max_deg_var);
 #endif
 
 #if DEBUG_SET_PARTITIONS
-    PrintVarTypes();
+    PrintVarTypes(Var_types);
 #endif
   
     if(sigIntFlag == 1){	/* TW 10/5/93 - Ctrl-C check */
@@ -127,56 +151,231 @@ printf("mp: %d %d %d %d\n", nVars, NUM_LETTERS, target_type_len, Max_deg_var);
       return(-1);
     }
 
-    vector<vector<Basis> > all_Substitutions;
+    if (Ctx.max_deg_var == 1)
+        return(PerformMultilinearSubstitution(Ctx, Var_types));
+
+    Ctx.permutations.Reset(nVars, Deg_var_types);
+    Ctx.subs_batch_size = EQUATION_BATCH_SIZE / Ctx.permutations.Size();
+    if (Ctx.subs_batch_size < 1)
+        Ctx.subs_batch_size = 1;
+
+    Enumeration uncached;
+    const Enumeration *e = LookupEnumeration(Ctx, Var_types, uncached);
+    if (e == NULL)
+        return(Ctx.status);
+
+    const int size = Ctx.max_deg_var * nVars;
+    vector<Name> Set_partitions(size);
+    vector<vector<Basis> > Substitutions;
+    for (int p=0; p<(int)e->partitions.size() && Ctx.status == OK; p += size) {
+        Set_partitions.assign(e->partitions.begin() + p, e->partitions.begin() + p + size);
+#if DEBUG_SET_PARTITIONS
+        PrintSetPartitions(Ctx, Set_partitions);
+#endif
+        Substitution_generator gen(Set_partitions, nVars, Ctx.max_deg_var, Deg_var_types);
+
+        Ctx.pruned_substitutions += gen.NumPruned();
+
+        while (Ctx.status == OK && gen.NextBatch(Ctx.subs_batch_size, Substitutions) > 0) {
+            Ctx.status = CreateSubs(Ctx, Substitutions, 0, Substitutions.size());
+            if (Ctx.status == OK)
+                Ctx.status = Ctx.builder.Flush(Ctx.equations, false);
+            if (sigIntFlag == 1)
+                Ctx.status = -1;
+        }
+    }
+
+    return(Ctx.status);
+}
+
+
+/*******************************************************************/
+/* FUNCTION:                                                       */
+/*     PerformMultiplePartition() for an identity of degree one in */
+/*     every variable.  Each variable is its own set partition and */
+/*     has one permutation, so the substitution records are just   */
+/*     the product of the basis ranges of Var_types, run through   */
+/*     in odometer order with the last variable fastest.           */
+/*******************************************************************/
+int PerformMultilinearSubstitution(Generation_context &Ctx, const vector<Name> &Var_types)
+{
+    const int nVars = Var_types.size();
+
+    vector<Basis> cur(nVars);
+    for (int i=0; i<nVars; i++) {
+        if (BeginBasis(Var_types[i]) == 0)
+            return(Ctx.status);     /* No basis elements of that type. */
+        cur[i] = BeginBasis(Var_types[i]);
+    }
+
+    const int batch_size = EQUATION_BATCH_SIZE;
+    vector<vector<Basis> > Substitutions;
+    bool done = false;
+
+    while (!done && Ctx.status == OK) {
+        Substitutions.clear();
+        while (!done && (int)Substitutions.size() < batch_size) {
+            Substitutions.push_back(cur);
+
+            int k;
+            for (k=nVars-1; k>=0; k--)
+                if (cur[k] < EndBasis(Var_types[k]))
+                    break;
+            if (k < 0) {
+                done = true;
+                break;
+            }
+            cur[k]++;
+            for (int j=k+1; j<nVars; j++)
+                cur[j] = BeginBasis(Var_types[j]);
+        }
+
+        Ctx.status = CreateMultilinearSubs(Ctx, Substitutions);
+        if (Ctx.status == OK)
+            Ctx.status = Ctx.builder.Flush(Ctx.equations, false);
+        if (sigIntFlag == 1)
+            Ctx.status = -1;
+    }
+
+    return(Ctx.status);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Enumeration_cache -- emptied, with its counters.            */
+/* NOTE:                                                           */
+/*     Must be called outside parallel regions.  Entries of one    */
+/*     type are of no use to another, so this is done whenever the */
+/*     submemo is reset.                                           */
+/*******************************************************************/
+void ResetEnumerationCache(void)
+{
+    Enumeration_cache.clear();
+    Enumeration_hits = 0;
+    Enumeration_lookups = 0;
+    Enumeration_bytes = 0;
+}
+
+
+/*
+ * Counters of the enumeration cache since ResetEnumerationCache().
+ * MB is the memory held by the cached set partitions.
+ */
+void GetEnumerationCacheStats(long *Hits, long *Lookups, double *MB)
+{
+#pragma omp critical(enumeration_cache)
+    {
+      *Hits = Enumeration_hits;
+      *Lookups = Enumeration_lookups;
+      *MB = Enumeration_bytes / (1024. * 1024.);
+    }
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     The enumeration for the variables of Ctx with the types     */
+/*     Var_types, from the cache or else made and entered in it.   */
+/*     Once the cache holds ENUMERATION_CACHE_LIMIT bytes it is    */
+/*     made in Uncached instead.  NULL if Ctx.status went bad      */
+/*     while making it.                                            */
+/* NOTE:                                                           */
+/*     Two threads missing on the same key both make it; the first */
+/*     entered is kept.                                            */
+/*******************************************************************/
+const Enumeration *LookupEnumeration(Generation_context &Ctx, const vector<Name> &Var_types, Enumeration &Uncached)
+{
+    const Enumeration_key key(Ctx.deg_vars, Var_types);
+    const Enumeration *found = NULL;
+
+#pragma omp critical(enumeration_cache)
     {
-      vector<Name> Set_partitions(Max_deg_var * nVars, 0);
+      Enumeration_lookups++;
+      map<Enumeration_key, Enumeration>::const_iterator ii = Enumeration_cache.find(key);
+      if (ii != Enumeration_cache.end()) {
+          Enumeration_hits++;
+          found = &ii->second;
+      }
+    }
+    if (found != NULL)
+        return(found);
+
+    Enumeration &e = Uncached;
+    {
+      const int nVars = Ctx.num_vars;
+      vector<Name> Set_partitions(Ctx.max_deg_var * nVars, 0);
       vector<int> Cur_index_var(nVars, 0); 
 
-      SplitJthType(Var_types, 0, Set_partitions, Cur_index_var, all_Substitutions);     /* Start a recursive call. */
+      SplitJthType(Ctx, Var_types, 0, Set_partitions, Cur_index_var, e);     /* Start a recursive call. */
     }
+    if (Ctx.status != OK)
+        return(NULL);
+
+    e.bytes = e.partitions.size() * sizeof(Name) + sizeof(Enumeration_key) +
+        (key.first.size() + key.second.size()) * sizeof(int);
+    found = &e;
 
-    status = CreateSubs(equations, The_ident, nVars, Max_deg_var, all_Substitutions, Deg_var_types);
+#pragma omp critical(enumeration_cache)
+    {
+      if (Enumeration_bytes + e.bytes <= ENUMERATION_CACHE_LIMIT) {
+          pair<map<Enumeration_key, Enumeration>::iterator, bool> ins =
+              Enumeration_cache.insert(make_pair(key, Enumeration()));
+          if (ins.second) {
+              ins.first->second.partitions.swap(e.partitions);
+              ins.first->second.bytes = e.bytes;
+              Enumeration_bytes += e.bytes;
+          }
+          found = &ins.first->second;
+      }
+    }
 
-    return(status);
+    return(found);
 }
 
 
 /* 
- * SplitJthType() and Gen() call each other recursively.
+ * SplitJthType() and Gen() call each other recursively, appending each
+ * set partition to E.
  */
 
-void SplitJthType(const vector<Name> &Var_types, int j, vector<Name> &Set_partitions, vector<int> &Cur_index_var, vector<vector<Basis> > &all_Substitutions)
+void SplitJthType(Generation_context &Ctx, const vector<Name> &Var_types, int j, vector<Name> &Set_partitions, vector<int> &Cur_index_var, Enumeration &E)
 {
-    if (status != OK)
+    if (Ctx.status != OK)
         return;
 
     int nVars = Var_types.size();
 
     if (j < nVars) {
-        Gen(Var_types, Var_types[j], Deg_var_types[j], j, Set_partitions, Cur_index_var, all_Substitutions); //List);
-    } else if (OKSetPartitions(nVars, Set_partitions)) {
-#if DEBUG_SET_PARTITIONS
-        PrintSetPartitions();
-#endif
-      vector<Basis> tmp(nVars * Max_deg_var);
-      //all_Substitutions.resize(all_Substitutions.size() + 1);
-      BuildSubs(Set_partitions, Max_deg_var, Deg_var_types, 0, 0, tmp, nVars, all_Substitutions); //..back());
+        Gen(Ctx, Var_types, Var_types[j], Ctx.deg_vars[j], j, Var_types[j], Set_partitions, Cur_index_var, E);
+    } else {
+      E.partitions.insert(E.partitions.end(), Set_partitions.begin(), Set_partitions.end());
+      if (sigIntFlag == 1)
+          Ctx.status = -1;
     }
 }
 
 
-void Gen(const vector<Name> &Var_types, Name n, int d, int j, vector<Name> &Set_partitions, vector<int> &Cur_index_var, vector<vector<Basis> > &all_Substitutions)
+/*
+ * The parts of a variable are produced in nonincreasing order of name,
+ * so each set partition is produced once.  Max_name is the previous
+ * part, which bounds the next one.  Names increase with degree, so no
+ * part may have a larger degree than Max_name.
+ */
+void Gen(Generation_context &Ctx, const vector<Name> &Var_types, Name n, int d, int j, Name Max_name, vector<Name> &Set_partitions, vector<int> &Cur_index_var, Enumeration &E)
 {
     int i,degn,lower,upper;
-    Name n1,n_minus_n1;
+    Name n1;
 
     int nVars = Var_types.size();
 
-    if (status != OK)
+    if (Ctx.status != OK)
         return;
     if (d == 1) {
+        if (n > Max_name)
+            return;
         AddSetPartition(nVars, n,j, Set_partitions, Cur_index_var);
-        SplitJthType(Var_types, j+1, Set_partitions, Cur_index_var, all_Substitutions);
+        SplitJthType(Ctx, Var_types, j+1, Set_partitions, Cur_index_var, E);
         DeleteSetPartition(j, Cur_index_var);
     }
     else {
@@ -186,16 +385,17 @@ void Gen(const vector<Name> &Var_types, Name n, int d, int j, vector<Name> &Set_
         else
             lower = degn/d + 1;
         upper = degn - d + 1;
+        if (upper > GetDegreeName(Max_name))
+            upper = GetDegreeName(Max_name);
+
         for (i=lower;i <= upper;i++) {
-            n1 = FirstTypeDegree(i);
-            while ((n1 != -1) && (status == OK)) {
-                if (IsSubtype(n1,n)) {
-                    AddSetPartition(nVars, n1, j, Set_partitions, Cur_index_var);
-                    SubtractTypeName(n,n1,&n_minus_n1);
-                    Gen(Var_types, n_minus_n1, d-1, j, Set_partitions, Cur_index_var, all_Substitutions);
-                    DeleteSetPartition(j, Cur_index_var);
-                }
-                n1 = NextTypeSameDegree(n1);
+            const Name *subtypes, *complements;
+            int num = SubtypesOfDegree(n, i, &subtypes, &complements);
+            for (int k=0; k<num && subtypes[k] <= Max_name && Ctx.status == OK; k++) {
+                n1 = subtypes[k];
+                AddSetPartition(nVars, n1, j, Set_partitions, Cur_index_var);
+                Gen(Ctx, Var_types, complements[k], d-1, j, n1, Set_partitions, Cur_index_var, E);
+                DeleteSetPartition(j, Cur_index_var);
             }
         }
     }
@@ -215,41 +415,29 @@ void DeleteSetPartition(Name j, vector<int> &Cur_index_var)
 }
 
 
-int OKSetPartitions(int nVars, const vector<Name> &Set_partitions)
-{
-    int i,j;
-
-    for (j=0;j<nVars;j++)
-        for (i=0;i<(Deg_var_types[j]-1);i++)
-            if (Set_partitions[i*nVars + j] < Set_partitions[(i+1)*nVars + j])
-                return(0);
-
-    return(1);
-}
-
 
 #if DEBUG_SET_PARTITIONS
-void PrintVarTypes(void)
+void PrintVarTypes(const vector<Name> &Var_types)
 {
     int i;
 
     printf("Variable Types are : \n");
-    for (i=0;i<Num_vars;i++) {
+    for (i=0;i<(int)Var_types.size();i++) {
         PrintTypeName(Var_types[i], stdout);	/* TW 9/26/93 - added stdout */
         printf("\n");
     }
 }
 
-void PrintSetPartitions(void)
+void PrintSetPartitions(const Generation_context &Ctx, const vector<Name> &Set_partitions)
 {
     int i,j;
     static int count = 0;
 
     printf("%d th partition is \n",count++);
 
-    for (j=0;j<Num_vars;j++)
-        for (i=0;i<Deg_var_types[j];i++) {
-            PrintTypeName(Set_partitions[i*Num_vars + j], stdout);	/* TW 9/26/93 - added stdout */
+    for (j=0;j<Ctx.num_vars;j++)
+        for (i=0;i<Ctx.deg_vars[j];i++) {
+            PrintTypeName(Set_partitions[i*Ctx.num_vars + j], stdout);	/* TW 9/26/93 - added stdout */
             printf("\n");
         }
 }
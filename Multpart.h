@@ -4,6 +4,10 @@
 #include "Build_defs.h"
 #include "CreateSubs.h"
 
-int PerformMultiplePartition(const struct polynomial *Id, Equations &equations, int Nvars, Type Types, const int *Deg_var);
+struct Generation_context;
+
+int PerformMultiplePartition(Generation_context &Ctx);
+void ResetEnumerationCache(void);
+void GetEnumerationCacheStats(long *Hits, long *Lookups, double *MB);
 
 #endif
@@ -8,39 +8,35 @@
 /***                        variables of this type                 ***/
 /***  PUBLIC ROUTINES:                                             ***/
 /***      int PerformSubs()                                        ***/
+/***      void Permutation_space::Reset()                          ***/
+/***      void Permutation_space::Unrank()                         ***/
+/***      bool Permutation_space::Next()                           ***/
+/***      void ResetSubMemo()                                      ***/
 /***  PRIVATE ROUTINES:                                            ***/
-/***      int FreePermutationList()                                ***/
-/***      int PrintPermutationList()                               ***/
-/***      int PrintPermutation()                                   ***/
-/***      int DoPermutation()                                      ***/
-/***      int AppendLocalListToTheList()                           ***/
-/***      Perm GetFirstPermutation()                               ***/
-/***      Perm GetNextPermutation()                                ***/
-/***      int  GetIndex()                                          ***/
-/***      int GetOtherIndexToSwap()                                ***/
-/***      int SortPermutation()                                    ***/
-/***      int Expand()                                             ***/
-/***      int FreeLocalList()                                      ***/
-/***      int AppendToLocalList()                                  ***/
-/***      int SubstituteWord()                                     ***/
-/***      int Sub()                                                ***/
-/***      Basis_pair_node *GetNewBPNode()                          ***/
+/***      bool Expand()                                            ***/
+/***      Sub_scratch &ThreadScratch()                             ***/
+/***      unsigned long MemoHash()                                 ***/
+/***      const Memo_slot *FindMemo()                              ***/
+/***      Memo_slot &AddMemo()                                     ***/
+/***      void ClearMemo()                                         ***/
+/***      void SubstituteWord()                                    ***/
+/***      void Sub()                                               ***/
 /***  MODULE DESCRIPTION:                                          ***/
 /***      Given an identity and a substitution record, we perform  ***/
 /***      the actual substitution in this module. We have to       ***/
 /***      permute a variable in all possible ways. i.e if the      ***/
 /***      degree of a variable is 4 then we have 24 permutations,  ***/
-/***      resulting in 24 equations. The permuations are obtatined ***/
-/***      using recursion and selection sort. The equations are    ***/
-/***      appended to the list of equations L. An equation is      ***/
-/***      obtained by substituting basis elements in place of      ***/
-/***      variables in the equation and multiplying out all the    ***/
-/***      basis elements whose products are stored in the          ***/
-/***      multiplication table. So new basis elements and new      ***/
-/***      products are detrmined by solving these equations.       ***/ 
+/***      resulting in 24 equations. The permutations are ranked   ***/
+/***      by Permutation_space, so a block of them can start       ***/
+/***      anywhere. The equations go to the local lists of their   ***/
+/***      lanes. An equation is obtained by substituting basis     ***/
+/***      elements in place of variables in the equation and       ***/
+/***      multiplying out all the basis elements whose products    ***/
+/***      are stored in the multiplication table. So new basis     ***/
+/***      elements and new products are detrmined by solving these ***/
+/***      equations.                                               ***/
 /*********************************************************************/
 
-#include <map>
 #include <list>
 #include <vector>
 #include <algorithm>
@@ -48,159 +44,453 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 
 #include <omp.h>
 
 #include "PerformSub.h"
 #include "Build_defs.h"
-#include "Alg_elements.h"
+#include "Basis_table.h"
 #include "CreateMatrix.h"
 #include "GenerateEquations.h"
+#include "Id_dag.h"
 #include "Memory_routines.h"
+#include "Mult_table.h"
 #include "Po_parse_exptext.h"
-#include "Debug.h"
 #include "Scalar_arithmetic.h"
 
 using namespace std;
 
-#if DEBUG_PERMUTATIONS
-static void PrintPermutationList(void);
-static void PrintPermutation(int Var_num, Perm P);
-#endif
-//void BuildPermutationLists(int nVars, const int *Dv, vector<vector<vector<int> > > &permutations);
-static void BuildPermutations(int row, vector<vector<int> > &Permutation_list, vector<vector<vector<int> > > &permutations);
-//static void AppendLocalListToTheList(const vector<vector<Basis_pair> > &Local_list, Eqn_list_node *L);
-static bool Expand(const vector<Basis> &Substitution, const struct polynomial *The_ident, vector<Basis_pair> &Local_list, const vector<vector<int> > &Permutation_list);
-static int SubstituteWord(const vector<Basis> &Substitution, const struct term_node *W, vector<Basis_pair> &running_list, const vector<vector<int> > &Permutation_list);
-static void Sub(const vector<Basis> &Substitution, Alg_element &Ans, const struct term_node *W, const vector<vector<int> > &Permutation_list);
+static bool Expand(const vector<Sub_lane> &Lanes, const Identity_dag &Dag, int Max_deg_var,
+                   long *Hits, long *Lookups, double *Saved);
 
-static int Max_deg_var = 0;
+/*
+ * A register of the interpreter: the nonzero terms of an algebra
+ * element in no particular order.  Registers are reused from one
+ * evaluation to the next, so their storage is allocated only once.
+ */
+typedef vector<pair<Basis, Scalar> > Register;
+
+/*
+ * A node of an identity DAG expands to the same element whenever its
+ * leaves receive the same basis elements, so MUL results are keyed on
+ * the node and those basis elements, padded with zeros.  MULs with
+ * more leaves than a key holds are neither shared nor memoized.
+ */
+#define MEMO_KEY_LEAVES 16
+
+struct Memo_key {
+    const Identity_dag *dag;    /* NULL for an empty slot. */
+    int node;
+    Basis leaves[MEMO_KEY_LEAVES];
+
+    Memo_key() : dag(NULL), node(0) { memset(leaves, 0, sizeof(leaves)); }
+    bool operator==(const Memo_key &K) const
+    {
+        return dag == K.dag && node == K.node && memcmp(leaves, K.leaves, sizeof(leaves)) == 0;
+    }
+};
+
+/*
+ * Slot of the memo, an open addressed table.  cost is the time the
+ * expansion took, which a hit saves.  Slots keep the storage of their
+ * values when the memo is emptied.
+ */
+struct Memo_slot {
+    Memo_key key;
+    Register value;
+    double cost;
+
+    Memo_slot() : key(), value(), cost(0) {}
+};
+
+#define MIN_MEMO_BITS   10
+
+/*
+ * Everything one thread needs to run identity programs.  A block of
+ * lanes is run together, so the per register arrays hold one row of
+ * NumRegisters() entries per lane.  It lives as long as its thread,
+ * holding a slot of Scratch meanwhile.
+ */
+struct Sub_scratch {
+    vector<Register> reg;
+    vector<double> cost;        /* Time spent computing each register. */
+    vector<char> state;         /* Per register: UNUSED, NEEDED, READY or SHARED. */
+    vector<int> owner;          /* Lane whose register holds the value. */
+    vector<Memo_key> keys;      /* Of each memoized MUL. */
+    Product_acc acc;            /* Dense accumulator indexed by basis. */
+
+    vector<Memo_slot> memo;
+    int memo_bits;
+    long memo_used;
+
+    int slot;
+
+    Sub_scratch();
+    ~Sub_scratch();
+
+private:
+    Sub_scratch(const Sub_scratch &);
+    Sub_scratch &operator=(const Sub_scratch &);
+};
+
+/* SHARED: the register of an earlier lane of the block is used. */
+enum { UNUSED, NEEDED, READY, SHARED };
+
+static vector<Sub_scratch *> Scratch;   /* Of live threads, NULL where one exited. */
+static thread_local Sub_scratch Thread_scratch;
+
+static Sub_scratch &ThreadScratch(void);
+static unsigned long MemoHash(const Memo_key &K, int Bits);
+static const Memo_slot *FindMemo(const Sub_scratch &W, const Memo_key &K);
+static Memo_slot &AddMemo(Sub_scratch &W, const Memo_key &K);
+static void ClearMemo(Sub_scratch &W);
 
-int PerformSubs(const vector<Basis> &S, const struct polynomial *F, int Mdv, vector<vector<int> > &permutation, vector<Basis_pair> &Local_list)
+static void SubstituteWord(Scalar Coef, const Register &ae1, const Register &ae2, Basis_pair_list &running_list);
+static void Sub(const Register &ae1, const Register &ae2, Register &Ans, Product_acc &Acc);
+
+
+/*
+ * Lanes -- a block of substitution records and permutations, each with
+ *          the weight multiplying every term of its equation.
+ * *Hits, *Lookups, *Saved -- memo hits, lookups and the seconds saved
+ *          by the hits are added to them.
+ */
+int PerformSubs(const Generation_context &Ctx, const vector<Sub_lane> &Lanes, long *Hits, long *Lookups, double *Saved)
 {
-    Max_deg_var = Mdv;
-    return Expand(S, F, Local_list, permutation);
+    return Expand(Lanes, Ctx.dag, Ctx.max_deg_var, Hits, Lookups, Saved) ? OK : 0;
 }
 
-void BuildPermutationLists(int nVars, const int *Dv, vector<vector<vector<int> > > &permutations) {
-      vector<vector<int> > Permutation_list(nVars);
-      for(int rr=0; rr<nVars; rr++) {
-          Permutation_list[rr].resize(Dv[rr]);
-#if 0
-          iota(Permutation_list[rr].begin(), Permutation_list[rr].end(), 1); // 1, 2, ...
-#else
-          for(int i=0; i<(int)Permutation_list[rr].size(); i++) {
-            Permutation_list[rr][i] = i+1;
-          }
-#endif
-      }
-
-      BuildPermutations(0, Permutation_list, permutations);
-    }
 
-#if DEBUG_PERMUTATIONS
-void PrintPermutationList(void)
+/*
+ * Takes the first free slot of Scratch.
+ */
+Sub_scratch::Sub_scratch()
+  : reg(), cost(), state(), owner(), keys(), acc(), memo(1 << MIN_MEMO_BITS),
+    memo_bits(MIN_MEMO_BITS), memo_used(0), slot(0)
 {
-    printf("Permuatation List is :\n");
-    for (int i=0; i<(int)Permutation_list.size(); i++) {
-        printf("%d %d: ", i, Permutation_list[i].size());
-        for (int j=0; j<(int)Permutation_list[i].size(); j++)
-          printf("%d", Permutation_list[i][j]);
-        printf("\n");
+#pragma omp critical(sub_scratch)
+    {
+        slot = find(Scratch.begin(), Scratch.end(), (Sub_scratch *)NULL) - Scratch.begin();
+        if (slot == (int)Scratch.size())
+            Scratch.push_back(this);
+        else
+            Scratch[slot] = this;
     }
 }
 
 
-void PrintPermutation(int Var_num, Perm P)
+/*
+ * Gives back the slot as the thread exits.
+ */
+Sub_scratch::~Sub_scratch()
+{
+#pragma omp critical(sub_scratch)
+    Scratch[slot] = NULL;
+}
+
+
+/*
+ * The scratch space of the calling thread, made on its first use.
+ * Threads of nested teams each get their own, whatever their number
+ * within the team.
+ */
+Sub_scratch &ThreadScratch(void)
 {
-    printf("%d %d: ", Var_num, Permutation_list[Var_num].size());
-    for (int i=0; i<Permutation_list[Var_num].size(); i++)
-        printf("%d",P[i]);
+    return Thread_scratch;
 }
-#endif
 
-void BuildPermutations(int row, vector<vector<int> > &Permutation_list, vector<vector<vector<int> > > &permutations)
+/*
+ * Slot of the memo where the search for K starts.
+ */
+unsigned long MemoHash(const Memo_key &K, int Bits)
+{
+    uint64_t h = (uint64_t)(uintptr_t)K.dag ^ (uint64_t)K.node << 32;
+    for (int i=0; i<MEMO_KEY_LEAVES && K.leaves[i] != 0; i++)
+        h = (h ^ K.leaves[i]) * 0x9e3779b97f4a7c15ULL;
+    h *= 0x9e3779b97f4a7c15ULL;
+    return h >> (64 - Bits);
+}
+
+
+/*
+ * The slot of W's memo holding K, NULL if there is none.
+ */
+const Memo_slot *FindMemo(const Sub_scratch &W, const Memo_key &K)
 {
-  if(row == (int)Permutation_list.size()) {
-#if DEBUG_PERMUTATIONS
-    PrintPermutationList();
-#endif
-
-/* Do the actual substitution using the current permutations of all variables. */
-
-    permutations.push_back(Permutation_list);
-  } else {
-    do {
-      BuildPermutations(row + 1, Permutation_list, permutations);
-    } while(next_permutation(Permutation_list[row].begin(), Permutation_list[row].end()));
-  }
+    const unsigned long mask = W.memo.size() - 1;
+    for (unsigned long s = MemoHash(K, W.memo_bits); ; s = (s + 1) & mask) {
+        if (W.memo[s].key.dag == NULL)
+            return NULL;
+        if (W.memo[s].key == K)
+            return &W.memo[s];
+    }
 }
-        
-        
-void AppendLocalListToTheList(const vector<vector<Basis_pair> > &Local_lists, Equations &equations)
+
+
+/*
+ * The slot of W's memo for K, made if need be.  The memo is emptied
+ * once it holds SUB_MEMO_LIMIT results, and grows to keep at most half
+ * its slots used.
+ */
+Memo_slot &AddMemo(Sub_scratch &W, const Memo_key &K)
 {
-#if 0
-    int ll_length = 0;
-    for(int i=0; i<(int)Local_lists.size(); i++) {
-      ll_length += Local_lists[i].size();
+    if (W.memo_used >= SUB_MEMO_LIMIT)
+        ClearMemo(W);
+
+    if (2 * (W.memo_used + 1) > (long)W.memo.size()) {
+        vector<Memo_slot> old(W.memo.size() * 2);
+        old.swap(W.memo);
+        W.memo_bits++;
+        const unsigned long mask = W.memo.size() - 1;
+        for (int i=0; i<(int)old.size(); i++) {
+            if (old[i].key.dag == NULL)
+                continue;
+            unsigned long s = MemoHash(old[i].key, W.memo_bits);
+            while (W.memo[s].key.dag != NULL)
+                s = (s + 1) & mask;
+            W.memo[s].key = old[i].key;
+            W.memo[s].value.swap(old[i].value);
+            W.memo[s].cost = old[i].cost;
+        }
     }
 
-    if(ll_length > 0) {
-printf("ll_l:%d eqs:%d lls:%d ", ll_length, (int)equations.size(), (int)Local_lists.size());
-      Equation eqn;
-      eqn.reserve(ll_length);
-      LocalListToEquation(Local_lists, eqn);
-      equations.push_back(eqn);
-   }
-#endif
+    const unsigned long mask = W.memo.size() - 1;
+    unsigned long s = MemoHash(K, W.memo_bits);
+    while (W.memo[s].key.dag != NULL && !(W.memo[s].key == K))
+        s = (s + 1) & mask;
+    if (W.memo[s].key.dag == NULL) {
+        W.memo[s].key = K;
+        W.memo_used++;
+    }
+
+    return W.memo[s];
 }
 
-void LocalListToEquation(const vector<vector<Basis_pair> > &Local_lists, Equation &eqn) {
-#if 0
-    int ll_length = 0;
-    for(int i=0; i<(int)Local_lists.size(); i++) {
-      ll_length += Local_lists[i].size();
+
+/*
+ * Empties W's memo, keeping its slots and their storage.
+ */
+void ClearMemo(Sub_scratch &W)
+{
+    for (int i=0; i<(int)W.memo.size(); i++) {
+        W.memo[i].key.dag = NULL;
+        W.memo[i].value.clear();
     }
+    W.memo_used = 0;
+}
 
-printf("ll_l:%d lls:%d ", ll_length, (int)Local_lists.size());
-      eqn.reserve(ll_length);
 
-      vector<vector<Basis_pair> >::const_iterator ii;
-      for(ii = Local_lists.begin(); ii != Local_lists.end(); ii++) {
-        eqn.insert(eqn.end(), ii->begin(), ii->end());
-      }
-#endif
+/*
+ * Keeps the current space if the variable degrees are unchanged.
+ */
+void Permutation_space::Reset(int nVars, const int *Dv)
+{
+    if ((int)deg_var.size() == nVars && equal(deg_var.begin(), deg_var.end(), Dv))
+        return;
+
+    deg_var.assign(Dv, Dv + nVars);
+    radix.resize(nVars);
+
+    size = 1;
+    for (int i=nVars-1; i>=0; i--) {
+        radix[i] = size;
+        for (int k=2; k<=deg_var[i]; k++)
+            size *= k;
+    }
+}
+
+
+/*
+ * Permutation -- the combination with flat index Index.  Each variable's
+ * share of the index is read as a Lehmer code in the factorial base.
+ */
+void Permutation_space::Unrank(long Index, vector<vector<int> > &Permutation) const
+{
+    Permutation.resize(deg_var.size());
+
+    for (int i=0; i<(int)deg_var.size(); i++) {
+        long r = Index / radix[i];
+        Index %= radix[i];
+
+        const int d = deg_var[i];
+        long f = 1;
+        for (int k=2; k<d; k++)
+            f *= k;
+
+        vector<int> &p = Permutation[i];
+        p.resize(d);
+        for (int k=0; k<d; k++)
+            p[k] = k+1;
+
+        /* Move the selected element forward; the rest stay in order. */
+        for (int k=0; k<d-1; k++) {
+            const int digit = r / f;
+            r %= f;
+            rotate(p.begin() + k, p.begin() + k + digit, p.begin() + k + digit + 1);
+            f /= d-1-k;
+        }
+    }
+}
+
+
+/*
+ * Steps Permutation to the combination with the next flat index.
+ * RETURNS false, with Permutation back at index 0, after the last one.
+ */
+bool Permutation_space::Next(vector<vector<int> > &Permutation) const
+{
+    for (int i=deg_var.size()-1; i>=0; i--) {
+        if (next_permutation(Permutation[i].begin(), Permutation[i].end()))
+            return true;
+    }
+    return false;
 }
 
+
 /*
  * We are getting to the core of the internals.
  */
 
-bool Expand(const vector<Basis> &Substitution, const struct polynomial *The_ident, vector<Basis_pair> &Local_list, const vector<vector<int> > &Permutation_list)
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Lanes[l].local_list -- the basis pairs of the equation of   */
+/*         lane l are appended, in the order a lane run on its own */
+/*         would append them.                                      */
+/* FUNCTION:                                                       */
+/*     Run the program of the identity for a block of substitution */
+/*     records and permutations.  The lanes run the same program   */
+/*     and differ only in the basis elements at the leaves.  A     */
+/*     backward pass, lane by lane, marks the registers the terms  */
+/*     need, stopping at a MUL whose leaves match those of an      */
+/*     earlier lane of the block, whose register is then shared,   */
+/*     or failing that one found in the memo.  A forward pass then */
+/*     runs the program once, each instruction over all the lanes. */
+/*******************************************************************/
+bool Expand(const vector<Sub_lane> &Lanes, const Identity_dag &Dag, int Max_deg_var,
+            long *Hits, long *Lookups, double *Saved)
 {
-//putchar('#');
-    if (The_ident == NULL)
-        return true;
+    const vector<Identity_dag::Instruction> &program = Dag.Program();
+    const vector<int> &leaf_registers = Dag.LeafRegisters();
+    const int nreg = Dag.NumRegisters();
+    const int nlanes = Lanes.size();
+
+    Sub_scratch &w = ThreadScratch();
+
+    if (w.reg.size() < (size_t)(nlanes * nreg)) {
+        w.reg.resize(nlanes * nreg);
+        w.cost.resize(nlanes * nreg);
+        w.state.resize(nlanes * nreg);
+        w.owner.resize(nlanes * nreg);
+        w.keys.resize(nlanes * nreg);
+    }
+    PrepareProductAcc(w.acc);
+
+    for (int l=0; l<nlanes; l++) {
+        const vector<Basis> &Substitution = Lanes[l].substitution;
+        const vector<vector<int> > &Permutation_list = Lanes[l].permutation;
+        const int row = l * nreg;
+
+        for (int i=0; i<(int)program.size(); i++) {
+            const Identity_dag::Instruction &ins = program[i];
+            if (ins.op == Identity_dag::OP_LEAF) {
+                const Basis b = Substitution[ins.a*Max_deg_var + Permutation_list[ins.a][ins.b] - 1];
+                w.reg[row + ins.dst].assign(1, make_pair(b, S_one()));
+                w.cost[row + ins.dst] = 0;
+                w.state[row + ins.dst] = READY;
+                w.owner[row + ins.dst] = l;
+            } else if (ins.op == Identity_dag::OP_MUL) {
+                w.state[row + ins.dst] = UNUSED;
+                w.owner[row + ins.dst] = l;
+            } else {
+                if (w.state[row + ins.a] == UNUSED)
+                    w.state[row + ins.a] = NEEDED;
+                if (w.state[row + ins.b] == UNUSED)
+                    w.state[row + ins.b] = NEEDED;
+            }
+        }
 
-    term_head *temp_head = The_ident->terms;
+        for (int i=program.size()-1; i>=0; i--) {
+            const Identity_dag::Instruction &ins = program[i];
+            if (ins.op != Identity_dag::OP_MUL || w.state[row + ins.dst] != NEEDED)
+                continue;
+
+            if (ins.leaf_begin < ins.leaf_end && ins.leaf_end - ins.leaf_begin <= MEMO_KEY_LEAVES) {
+                Memo_key &key = w.keys[row + ins.dst];
+                key.dag = &Dag;
+                key.node = ins.dst;
+                memset(key.leaves, 0, sizeof(key.leaves));
+                for (int j=ins.leaf_begin; j<ins.leaf_end; j++)
+                    key.leaves[j - ins.leaf_begin] = w.reg[row + leaf_registers[j]][0].first;
+
+                int k;
+                for (k=0; k<l; k++) {
+                    const char s = w.state[k*nreg + ins.dst];
+                    if ((s == NEEDED || s == READY) && w.keys[k*nreg + ins.dst] == key)
+                        break;
+                }
+                if (k < l) {
+                    w.state[row + ins.dst] = SHARED;
+                    w.owner[row + ins.dst] = k;
+                    continue;
+                }
 
-    while (temp_head) {
-//putchar('*');
-        vector<Basis_pair> running_list;
+                (*Lookups)++;
+                const Memo_slot *hit = FindMemo(w, key);
+                if (hit != NULL) {
+                    w.reg[row + ins.dst] = hit->value;
+                    w.cost[row + ins.dst] = hit->cost;
+                    w.state[row + ins.dst] = READY;
+                    (*Hits)++;
+                    *Saved += hit->cost;
+                    continue;
+                }
+            }
 
-        int alpha = temp_head->coef;
-        Scalar salpha = ConvertToScalar(alpha);
+            if (w.state[row + ins.a] == UNUSED)
+                w.state[row + ins.a] = NEEDED;
+            if (w.state[row + ins.b] == UNUSED)
+                w.state[row + ins.b] = NEEDED;
+        }
+    }
 
-        if (SubstituteWord(Substitution, temp_head->term, running_list, Permutation_list) != OK)
-            return false;
+    for (int i=0; i<(int)program.size(); i++) {
+        const Identity_dag::Instruction &ins = program[i];
 
-        vector<Basis_pair>::iterator ii;
-        for(ii = running_list.begin(); ii != running_list.end(); ii++) {
-            ii->coef = S_mul(salpha, ii->coef);
+        if (ins.op == Identity_dag::OP_TERM) {
+            for (int l=0; l<nlanes; l++) {
+                const int a = w.owner[l*nreg + ins.a] * nreg + ins.a;
+                const int b = w.owner[l*nreg + ins.b] * nreg + ins.b;
+                SubstituteWord(S_mul(Lanes[l].weight, ins.coef), w.reg[a], w.reg[b], Lanes[l].local_list);
+            }
+            continue;
         }
+        if (ins.op != Identity_dag::OP_MUL)
+            continue;
+
+        for (int l=0; l<nlanes; l++) {
+            const int dst = l*nreg + ins.dst;
+            if (w.state[dst] != NEEDED)
+                continue;
+
+            const int a = w.owner[l*nreg + ins.a] * nreg + ins.a;
+            const int b = w.owner[l*nreg + ins.b] * nreg + ins.b;
+            const double start = omp_get_wtime();
+
+ /* This is where we use the multiplication table. */ 
+
+            Sub(w.reg[a], w.reg[b], w.reg[dst], w.acc);
+            w.state[dst] = READY;
 
-        Local_list.insert(Local_list.end(), running_list.begin(), running_list.end());
-        temp_head = temp_head->next;
+            w.cost[dst] = omp_get_wtime() - start + w.cost[a] + w.cost[b];
+
+            if (ins.leaf_begin < ins.leaf_end && ins.leaf_end - ins.leaf_begin <= MEMO_KEY_LEAVES) {
+                Memo_slot &e = AddMemo(w, w.keys[dst]);
+                e.value = w.reg[dst];
+                e.cost = w.cost[dst];
+            }
+        }
     }
 
     return true;
@@ -211,82 +501,57 @@ bool Expand(const vector<Basis> &Substitution, const struct polynomial *The_iden
  * THE HEART OF THE MATTER. WE HAVE REACHED THE CORE.
  * THE WHOLE IDEA OF DYNAMIC PROGRAMMING IS EMBEDDED IN THIS ROUTINE.
  * Form one term of the equation corresponding to the term in the
- * identity. 
+ * identity, from the expansions ae1 and ae2 of its left and right trees.
  */
 
-int SubstituteWord(const vector<Basis> &Substitution, const struct term_node *W, vector<Basis_pair> &running_list, const vector<vector<int> > &Permutation_list)
+void SubstituteWord(Scalar Coef, const Register &ae1, const Register &ae2, Basis_pair_list &running_list)
 {
-    Alg_element ae1;
-    Alg_element ae2;
-
-    Scalar zero = S_zero();
-    Scalar alpha,beta;
-
-    if (W == NULL){
-        return(OK);
-    }
-
-    Sub(Substitution, ae1, W->left, Permutation_list);   /* We can expand left tree of W. *//* TW 9/22/93 - change ae1 to *ae1 */
-    Sub(Substitution, ae2, W->right, Permutation_list);  /* We can expand the right tree of W. *//* TW 9/22/93 - change ae2 to *ae2 */
-
 /* We can't do any more expansion. i.e We can't multiply ae1 & ae2. */
 /* Because we are entering new basis elements of degree of W. */
 /* But now it is time for new basis pairs. */
 /* The equations are nothing but summation of basis pairs. */
 
-    map<Basis, Scalar>::const_iterator ae1i, ae2i;
-    
-    ae1i = ae1.begin();
-    while(ae1i != ae1.end()) {
-      if(ae1i->first != 0) {
-        alpha = ae1i->second;
-        if (alpha != zero) { /* TW 9/22/93 - change ae1 to *ae1 */
-          ae2i = ae2.begin();
-          while(ae2i != ae2.end()) {
-            if(ae2i->first != 0) {
-                beta = ae2i->second; /* TW 9/22/93 - change ae2 to *ae2 */
-                if(beta != zero) { /* TW 9/22/93 - change ae2 to *ae2 */
-                    Basis_pair bp;
-                    bp.coef = S_mul(alpha, beta);
-                    bp.left_basis = ae1i->first;
-                    bp.right_basis = ae2i->first;
-                    running_list.push_back(bp);
-                }
-            }
-            ae2i++;
+    for (Register::const_iterator ae1i = ae1.begin(); ae1i != ae1.end(); ae1i++) {
+        for (Register::const_iterator ae2i = ae2.begin(); ae2i != ae2.end(); ae2i++) {
+            Basis_pair bp;
+            bp.coef = S_mul(Coef, S_mul(ae1i->second, ae2i->second));
+            bp.left_basis = ae1i->first;
+            bp.right_basis = ae2i->first;
+            running_list.push_back(bp);
         }
-      }
-      }
-      ae1i++;
     }
-
-    return(OK);
 }
-                        
-
-void Sub(const vector<Basis> &Substitution, Alg_element &Ans, const struct term_node *W, const vector<vector<int> > &Permutation_list)
-{
-    assert_not_null_nv(W);
 
-    if ((W->left == NULL) && (W->right == NULL)) {
-        int var_number = GetVarNumber(W->letter) - 1;
 
-        int var_occurrence_number = W->number - 1;
-        int perm_number = Permutation_list[var_number][var_occurrence_number] - 1;
-
-        Basis b = Substitution[var_number*Max_deg_var + perm_number];
-
-        SetAE(Ans, b, 1); 
-    } else {
-        Alg_element left;
-        Alg_element right;
-    
-        Sub(Substitution, left, W->left, Permutation_list); 		/* TW 9/22/93 - change left to *left */
-        Sub(Substitution, right, W->right, Permutation_list); 		/* TW 9/22/93 - change right to *right */
+/*
+ * Ans -- ae1 times ae2, from the multiplication table.  The products
+ * are summed unreduced in Acc, which must be zero on entry and is zero
+ * on exit.  Products missing from the table are taken as zero.
+ */
+void Sub(const Register &ae1, const Register &ae2, Register &Ans, Product_acc &Acc)
+{
+    MultTerms(ae1, ae2, Acc);
+    CollectProducts(Acc, Ans);
+}
 
- /* This is where we use the multiplication table. */ 
 
-        MultAE(left, right, Ans);	/* TW 9/22/93 - change right to *right & left to *left */
-   }
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     The scratch space of every thread -- the memo of MUL        */
+/*     results emptied.                                            */
+/* NOTE:                                                           */
+/*     Must be called outside parallel regions, before the first   */
+/*     PerformSubs() and whenever the multiplication table used by */
+/*     the memo may change.                                        */
+/*******************************************************************/
+void ResetSubMemo(void)
+{
+#pragma omp critical(sub_scratch)
+    {
+        for (int i=0; i<(int)Scratch.size(); i++) {
+            if (Scratch[i] != NULL)
+                ClearMemo(*Scratch[i]);
+        }
+    }
 }
 
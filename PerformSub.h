@@ -11,11 +11,45 @@
 
 #include "Build_defs.h"
 #include "CreateMatrix.h"
-#include "GenerateEquations.h"
+#include "Id_dag.h"
 
-int PerformSubs(const std::vector<Basis> &S, const struct polynomial *F, int Mdv, std::vector<std::vector<int> > &permutation, std::vector<Basis_pair> &Local_list);
-void AppendLocalListToTheList(const std::vector<std::vector<Basis_pair> > &Local_list, Equations &equations);
-void LocalListToEquation(const std::vector<std::vector<Basis_pair> > &Local_lists, Equation &eqn);
-void BuildPermutationLists(int nVars, const int *Dv, std::vector<std::vector<std::vector<int> > > &permutations);
+/*
+ * All combinations of one permutation per variable, in the order of
+ * next_permutation() with the last variable varying fastest.  A
+ * combination is computed from its flat index instead of being stored.
+ */
+class Permutation_space {
+public:
+    Permutation_space() : deg_var(), radix(), size(1) {}
+
+    void Reset(int nVars, const int *Dv);
+    long Size() const { return size; }
+    void Unrank(long Index, std::vector<std::vector<int> > &Permutation) const;
+    bool Next(std::vector<std::vector<int> > &Permutation) const;
+
+private:
+    std::vector<int> deg_var;
+    std::vector<long> radix;        /* Combinations of the variables after each one. */
+    long size;
+};
+
+/*
+ * One (substitution record, permutation) of a block handed to
+ * PerformSubs().  Its equation list goes to local_list.
+ */
+struct Sub_lane {
+    Sub_lane(const std::vector<Basis> &S, const std::vector<std::vector<int> > &P, Scalar W, Basis_pair_list &L)
+      : substitution(S), permutation(P), weight(W), local_list(L) {}
+
+    const std::vector<Basis> &substitution;
+    std::vector<std::vector<int> > permutation;
+    Scalar weight;
+    Basis_pair_list &local_list;
+};
+
+struct Generation_context;
+
+int PerformSubs(const Generation_context &Ctx, const std::vector<Sub_lane> &Lanes, long *Hits, long *Lookups, double *Saved);
+void ResetSubMemo(void);
 
 #endif
@@ -21,6 +21,8 @@
 /***      homogeneous or not.                                      ***/
 /*********************************************************************/
 
+#include <vector>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,6 +34,7 @@
 #include "Debug.h"
 #include "Alg_elements.h"
 #include "Memory_routines.h"
+#include "Mult_table.h"
 #include "Scalar_arithmetic.h"
 
 static int Absolute(int Num);
@@ -43,7 +46,9 @@ static int Same_type(struct P_type type1, struct P_type type2);
 static void AssignNumbersToTerm(struct term_node *Pntr, int Cln[]);
 static void DestroyTerms(struct term_head *Term_head);
 static void FreeNodes(struct term_node *Term_node);
-static bool ExpandTerm(Alg_element &Ans, const struct term_node *W);
+static bool ExpandTerm(std::vector<std::pair<Basis, Scalar> > &Ans, const struct term_node *W);
+
+static thread_local Product_acc Expand_acc;     /* Scratch of ExpandTerm(), per thread. */
 
 /*******************************************************************/
 /* MODIFIES: None.                                                 */
@@ -443,14 +448,14 @@ int IsIdentity(const struct polynomial *Poly)
     while (temp_head) {
         Scalar alpha = ConvertToScalar(temp_head->coef);
 
-        Alg_element ae;
-        if(!ExpandTerm(ae, temp_head->term)) {
+        std::vector<std::pair<Basis, Scalar> > terms;
+        if(!ExpandTerm(terms, temp_head->term)) {
             printf("Severe Bug. Cant ExpandTerm. Basis product undefined\n");
             return(0);
         }
 
-        ScalarMultAE(alpha, ae);
-        AddAE(ae, result);
+        for (int i=0; i<(int)terms.size(); i++)
+            AccumAE(result, terms[i].first, S_mul(alpha, terms[i].second));
 
         temp_head = temp_head->next;
     }
@@ -459,21 +464,35 @@ int IsIdentity(const struct polynomial *Poly)
 }
 
 
-bool ExpandTerm(Alg_element &Ans, const struct term_node *W)
+/*
+ * Ans -- the term W in the basis.  The product at each node is summed
+ * unreduced in Expand_acc, which is free again once the children are
+ * expanded.  Returns false if a letter has no basis element or a
+ * product is missing from the table.
+ */
+bool ExpandTerm(std::vector<std::pair<Basis, Scalar> > &Ans, const struct term_node *W)
 {
     if(!W) return false;
 
+    Ans.clear();
     if(!W->left && !W->right) {
         Basis b = GetBasisNumberofLetter(W->letter);
-        SetAE(Ans, b, 1);
+        if (b == 0)
+            return false;
+        Ans.push_back(std::make_pair(b, S_one()));
         return true;
     }
 
-    Alg_element left;
-    Alg_element right;
+    std::vector<std::pair<Basis, Scalar> > left;
+    std::vector<std::pair<Basis, Scalar> > right;
+
+    if (!ExpandTerm(left, W->left) || !ExpandTerm(right, W->right))
+        return false;
+
+    PrepareProductAcc(Expand_acc);
+    const bool found = MultTerms(left, right, Expand_acc);
+    CollectProducts(Expand_acc, Ans);
 
-    return (ExpandTerm(left, W->left) && 
-            ExpandTerm(right, W->right) && 
-            MultAE(left, right, Ans));
+    return found;
 }
 
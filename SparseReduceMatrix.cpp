@@ -9,9 +9,9 @@
 /***                  Delete_Element()                          ***/
 /***                  Change_Element()                          ***/
 /***                  Locate_Node()                             ***/
-/***  PRIVATE ROUTINES:                                         ***/
 /***                  SparseMultRow()                           ***/
 /***                  SparseAddRow()                            ***/
+/***  PRIVATE ROUTINES:                                         ***/
 /***                  SparseKnockOut()                          ***/
 /***                  SparseInterchange()                       ***/
 /***                  Insert_Node()                             ***/
@@ -43,8 +43,6 @@ using std::lower_bound;
 #include "Build_defs.h"
 #include "Scalar_arithmetic.h"
 
-static void SparseMultRow(SparseMatrix &SM, int Row, Scalar Factor);
-static void SparseAddRow(SparseMatrix &SM, Scalar Factor, int Row1, int Row2);
 static void SparseKnockOut(SparseMatrix &SM, int row, int col);
 #if 0
 static void Print_Matrix(MAT_PTR Sparse_Matrix, int r, int c);
@@ -168,7 +166,10 @@ struct stats {
 };
 
 
-int SparseReduceMatrix(SparseMatrix &SM, int nCols, int *Rank)
+/*
+ * Show_progress -- print the progress of the reduction as it goes.
+ */
+int SparseReduceMatrix(SparseMatrix &SM, int nCols, int *Rank, bool Show_progress)
 {
     if(SM.empty() || nCols == 0)
     {
@@ -181,10 +182,11 @@ int SparseReduceMatrix(SparseMatrix &SM, int nCols, int *Rank)
     /* Search for the rightmost nonzero element */
     /* Dependent on the current stairrow */
 
-    putchar('\n');
+    if (Show_progress)
+        putchar('\n');
 
     stats s1;
-    s1.update(SM, 0, 0, nCols, -1, true);
+    s1.update(SM, 0, 0, nCols, -1, Show_progress);
 
     int nextstairrow = 0;
     for (int i=0;i<nCols;i++)
@@ -207,12 +209,13 @@ int SparseReduceMatrix(SparseMatrix &SM, int nCols, int *Rank)
            nextstairrow++;
         }
 
-        s1.update(SM, nextstairrow, i, nCols, 600, true);
+        s1.update(SM, nextstairrow, i, nCols, 600, Show_progress);
     }
     *Rank=nextstairrow;
-    s1.update(SM, nextstairrow, nCols, nCols, -1, true);
+    s1.update(SM, nextstairrow, nCols, nCols, -1, Show_progress);
 
-    printf("\n\t\t\t");
+    if (Show_progress)
+        printf("\n\t\t\t");
 
     return(OK);
 }
@@ -3,7 +3,9 @@
 
 #include "CreateMatrix.h"
 
-int SparseReduceMatrix(SparseMatrix &SM, int nCols, int *Rank);
+int SparseReduceMatrix(SparseMatrix &SM, int nCols, int *Rank, bool Show_progress);
 Scalar Get_Matrix_Element(const SparseMatrix &SM, int i, int j);
+void SparseMultRow(SparseMatrix &SM, int Row, Scalar Factor);
+void SparseAddRow(SparseMatrix &SM, Scalar Factor, int Row1, int Row2);
 
 #endif
@@ -0,0 +1,409 @@
+/*******************************************************************/
+/***  FILE :        Table_export.c                               ***/
+/***  PUBLIC ROUTINES:                                           ***/
+/***      int WriteMultTable()                                   ***/
+/***      int ExportMultTable()                                  ***/
+/***  PRIVATE ROUTINES:                                          ***/
+/***      void LeftBlocks()                                      ***/
+/***      void CollectRows()                                     ***/
+/***      void CountRows()                                       ***/
+/***      void FormatText()                                      ***/
+/***      void FormatCsv()                                       ***/
+/***      int WriteColumns()                                     ***/
+/***  MODULE DESCRIPTION:                                        ***/
+/***      Writing out the multiplication table.  Only the        ***/
+/***      products in the table are visited, in ascending order  ***/
+/***      of their left then right basis elements, a chunk of    ***/
+/***      left basis elements at a time.  The chunks of a window ***/
+/***      are formatted in parallel and then written in order,   ***/
+/***      so the output is the same however many threads run.    ***/
+/***                                                             ***/
+/***      EXPORT_TEXT is the format of view m.  EXPORT_CSV has   ***/
+/***      a row left,right,basis,coef for each term of each      ***/
+/***      product, and a row left,right,0,0 for a product known  ***/
+/***      to be zero.  EXPORT_COLUMNS is an Export_header and    ***/
+/***      then, at the offsets it gives, the columns            ***/
+/***          int32 left[products], int32 right[products],       ***/
+/***          int64 first[products + 1],                         ***/
+/***          int32 basis[terms], uint8 coef[terms],             ***/
+/***      the terms of product k being first[k] .. first[k+1]-1 ***/
+/***      in ascending basis order, in the byte order of the     ***/
+/***      machine that wrote them.  Its chunks are written in    ***/
+/***      parallel at offsets counted beforehand.                ***/
+/*******************************************************************/
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "Table_export.h"
+#include "Build_defs.h"
+#include "Basis_table.h"
+#include "driver.h"
+#include "Mult_table.h"
+#include "Scalar_arithmetic.h"
+#include "Type_table.h"
+
+using namespace std;
+
+#define EXPORT_CHUNK        64      /* Left basis elements of a chunk. */
+#define EXPORT_WINDOW       256     /* Chunks formatted before they are written. */
+
+/* The products of a chunk of the table. */
+struct Export_rows {
+    Export_rows() : left(), right(), first(), terms() {}
+
+    vector<Basis> left;
+    vector<Basis> right;
+    vector<int64_t> first;          /* Product k has terms first[k] .. first[k+1]-1. */
+    vector<pair<Basis, Scalar> > terms;
+};
+
+struct Export_header {
+    char magic[8];
+    int32_t version;
+    uint32_t byte_order;
+    int32_t field;
+    int32_t dimension;
+    int64_t products;
+    int64_t terms;
+    int64_t offset[5];              /* Of left, right, first, basis, coef. */
+};
+
+/* Orders the blocks of a left type by their right basis elements. */
+struct Right_order {
+    bool operator()(const Mt_block *A, const Mt_block *B) const { return A->right_begin < B->right_begin; }
+};
+
+typedef vector<vector<const Mt_block *> > Left_blocks;
+
+static void LeftBlocks(Left_blocks &Blocks);
+static void CollectRows(const Left_blocks &Blocks, Basis Begin, Basis End, Export_rows &Rows);
+static void CountRows(const Left_blocks &Blocks, Basis Begin, Basis End, int64_t *Products, int64_t *Terms);
+static void FormatText(const Export_rows &Rows, string &Out);
+static void FormatCsv(const Export_rows &Rows, string &Out);
+static int WriteColumns(const char *File, int64_t *Products, int64_t *Terms);
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     filePtr -- open for writing.                                */
+/*     Format -- EXPORT_TEXT or EXPORT_CSV.                        */
+/* RETURNS:                                                        */
+/*     OK if the whole table was written, 0 otherwise.             */
+/*******************************************************************/
+int WriteMultTable(FILE *filePtr, int Format)
+{
+    const Basis dim = GetNextBasisTobeFilled();
+    if (dim <= 0)
+        return(OK);
+
+    if (Format == EXPORT_TEXT)
+        fprintf(filePtr, "\nMultiplication table: \n");
+    else
+        fprintf(filePtr, "left,right,basis,coef\n");
+
+    Left_blocks blocks;
+    LeftBlocks(blocks);
+
+    const int chunks = (dim - 1 + EXPORT_CHUNK - 1) / EXPORT_CHUNK;
+    vector<string> out(min(chunks, EXPORT_WINDOW));
+    int status = OK;
+    for (int w = 0; w < chunks; w += EXPORT_WINDOW) {
+        const int n = min(EXPORT_WINDOW, chunks - w);
+#pragma omp parallel for schedule(dynamic)
+        for (int k = 0; k < n; k++) {
+            Export_rows rows;
+            const Basis b = 1 + (w + k) * EXPORT_CHUNK;
+            CollectRows(blocks, b, min(b + EXPORT_CHUNK, dim), rows);
+            out[k].clear();
+            if (Format == EXPORT_TEXT)
+                FormatText(rows, out[k]);
+            else
+                FormatCsv(rows, out[k]);
+        }
+        for (int k = 0; k < n; k++) {
+            if (fwrite(out[k].data(), 1, out[k].size(), filePtr) != out[k].size())
+                status = 0;
+        }
+    }
+
+    return(status);
+}
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     Format -- one of EXPORT_TEXT, EXPORT_CSV or EXPORT_COLUMNS. */
+/* RETURNS:                                                        */
+/*     OK if the table was written to File, 0 otherwise.           */
+/*******************************************************************/
+int ExportMultTable(const char *File, int Format)
+{
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    int64_t products = 0, terms = 0;
+    if (Format == EXPORT_COLUMNS) {
+        if (WriteColumns(File, &products, &terms) != OK)
+            return(0);
+    }
+    else {
+        FILE *fp = fopen(File, "w");
+        if (fp == NULL) {
+            printf("Unable to open file, %s.\n", File);
+            return(0);
+        }
+        int status = WriteMultTable(fp, Format);
+        if (fclose(fp) != 0)
+            status = 0;
+        if (status != OK) {
+            printf("Unable to write file, %s.\n", File);
+            return(0);
+        }
+    }
+
+    gettimeofday(&end, NULL);
+    const double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+    if (Format == EXPORT_COLUMNS)
+        printf("Exported %lld products, %lld terms, to %s in %.1f ms.\n",
+               (long long) products, (long long) terms, File, ms);
+    else
+        printf("Exported the multiplication table to %s in %.1f ms.\n", File, ms);
+
+    return(OK);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Blocks -- for each left type, its blocks in ascending order */
+/*               of their right basis elements.                    */
+/*******************************************************************/
+void LeftBlocks(Left_blocks &Blocks)
+{
+    Blocks.assign(GetTypeCount(), vector<const Mt_block *>());
+    map<pair<Name, Name>, Mt_block>::const_iterator mi;
+    for (mi = mult_table.begin(); mi != mult_table.end(); mi++)
+        Blocks[mi->first.first].push_back(&mi->second);
+    for (int l = 0; l < (int) Blocks.size(); l++)
+        sort(Blocks[l].begin(), Blocks[l].end(), Right_order());
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Rows -- the products b_i * b_j in the table for Begin <= i  */
+/*             < End, in ascending order of i then j, each with    */
+/*             its terms in ascending basis order.                 */
+/*******************************************************************/
+void CollectRows(const Left_blocks &Blocks, Basis Begin, Basis End, Export_rows &Rows)
+{
+    Rows.first.push_back(0);
+    for (Basis i = Begin; i < End; i++) {
+        const vector<const Mt_block *> &blks = Blocks[GetType(i)];
+        for (int b = 0; b < (int) blks.size(); b++) {
+            const Mt_block &blk = *blks[b];
+            const long row = (long) (i - blk.left_begin) * blk.cols;
+            const long end = min(blk.filled, row + blk.cols);
+            for (long c = row; c < end; c++) {
+                const Basis j = blk.right_begin + c - row;
+                const bool present = BlockCell(blk, i, j) >= 0;
+                const Basis n = present ? 0 : TrivialProduct(blk, i, j);
+                if (!present && n == 0)
+                    continue;
+                Rows.left.push_back(i);
+                Rows.right.push_back(j);
+                const size_t t = Rows.terms.size();
+                if (n != 0)
+                    Rows.terms.push_back(make_pair(n, S_one()));
+                const unsigned *r = Mt_rows + blk.row_begin + c;
+                for (long k = blk.term_begin + r[0]; k < blk.term_begin + r[1]; k++)
+                    Rows.terms.push_back(make_pair(TermBasis(blk, k), Mt_coefs[k]));
+                sort(Rows.terms.begin() + t, Rows.terms.end());
+                Rows.first.push_back(Rows.terms.size());
+            }
+        }
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Products, Terms -- the number of products and of terms that */
+/*         CollectRows() would give for Begin <= i < End.          */
+/*******************************************************************/
+void CountRows(const Left_blocks &Blocks, Basis Begin, Basis End, int64_t *Products, int64_t *Terms)
+{
+    *Products = 0;
+    *Terms = 0;
+    for (Basis i = Begin; i < End; i++) {
+        const vector<const Mt_block *> &blks = Blocks[GetType(i)];
+        for (int b = 0; b < (int) blks.size(); b++) {
+            const Mt_block &blk = *blks[b];
+            const long row = (long) (i - blk.left_begin) * blk.cols;
+            const long end = min(blk.filled, row + blk.cols);
+            for (long c = row; c < end; c++) {
+                const Basis j = blk.right_begin + c - row;
+                if (BlockCell(blk, i, j) >= 0) {
+                    const unsigned *r = Mt_rows + blk.row_begin + c;
+                    (*Products)++;
+                    *Terms += r[1] - r[0];
+                } else if (TrivialProduct(blk, i, j) != 0) {
+                    (*Products)++;
+                    (*Terms)++;
+                }
+            }
+        }
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Out -- Rows appended as view m prints them: the nonzero     */
+/*            products, four terms to a line.                      */
+/*******************************************************************/
+void FormatText(const Export_rows &Rows, string &Out)
+{
+    char buf[64];
+    for (int p = 0; p < (int) Rows.left.size(); p++) {
+        if (Rows.first[p] == Rows.first[p + 1])
+            continue;
+        snprintf(buf, sizeof(buf), "(b%d)*(b%d)\n", Rows.left[p], Rows.right[p]);
+        Out += buf;
+        int trmcnt = 0;
+        for (int64_t k = Rows.first[p]; k < Rows.first[p + 1]; k++, trmcnt++) {
+            if (trmcnt > 0 && trmcnt % 4 == 0)
+                Out += '\n';
+            snprintf(buf, sizeof(buf), "%s%3d b%-4d", trmcnt % 4 == 0 ? "   " : "+  ",
+                     (int) Rows.terms[k].second, Rows.terms[k].first);
+            Out += buf;
+        }
+        Out += "\n\n";
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Out -- Rows appended as left,right,basis,coef lines.        */
+/*******************************************************************/
+void FormatCsv(const Export_rows &Rows, string &Out)
+{
+    char buf[64];
+    for (int p = 0; p < (int) Rows.left.size(); p++) {
+        if (Rows.first[p] == Rows.first[p + 1]) {
+            snprintf(buf, sizeof(buf), "%d,%d,0,0\n", Rows.left[p], Rows.right[p]);
+            Out += buf;
+        }
+        for (int64_t k = Rows.first[p]; k < Rows.first[p + 1]; k++) {
+            snprintf(buf, sizeof(buf), "%d,%d,%d,%d\n", Rows.left[p], Rows.right[p],
+                     Rows.terms[k].first, (int) Rows.terms[k].second);
+            Out += buf;
+        }
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Products, Terms -- the number written.                      */
+/* RETURNS:                                                        */
+/*     OK if the table was written to File in EXPORT_COLUMNS       */
+/*     format, 0 otherwise.                                        */
+/*******************************************************************/
+int WriteColumns(const char *File, int64_t *Products, int64_t *Terms)
+{
+    const Basis dim = GetNextBasisTobeFilled();
+    Left_blocks blocks;
+    LeftBlocks(blocks);
+
+    /* Where each chunk's products and terms start. */
+    const int chunks = max(0, (dim - 1 + EXPORT_CHUNK - 1) / EXPORT_CHUNK);
+    vector<int64_t> product_base(chunks + 1, 0), term_base(chunks + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < chunks; k++) {
+        const Basis b = 1 + k * EXPORT_CHUNK;
+        CountRows(blocks, b, min(b + EXPORT_CHUNK, dim), &product_base[k + 1], &term_base[k + 1]);
+    }
+    for (int k = 0; k < chunks; k++) {
+        product_base[k + 1] += product_base[k];
+        term_base[k + 1] += term_base[k];
+    }
+
+    Export_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, EXPORT_MAGIC, sizeof(h.magic));
+    h.version = EXPORT_VERSION;
+    h.byte_order = 0x01020304;
+    h.field = GetField();
+    h.dimension = max(0, dim - 1);
+    h.products = product_base[chunks];
+    h.terms = term_base[chunks];
+    h.offset[0] = sizeof(h);
+    h.offset[1] = h.offset[0] + 4 * h.products;
+    h.offset[2] = h.offset[1] + 4 * h.products;
+    h.offset[3] = h.offset[2] + 8 * (h.products + 1);
+    h.offset[4] = h.offset[3] + 4 * h.terms;
+    const int64_t size = h.offset[4] + h.terms;
+
+    const int fd = open(File, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        printf("Unable to open file, %s.\n", File);
+        return(0);
+    }
+    int status = OK;
+    if (ftruncate(fd, size) != 0 || pwrite(fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h) ||
+        pwrite(fd, &h.terms, 8, h.offset[2] + 8 * h.products) != 8)
+        status = 0;
+
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < chunks; k++) {
+        Export_rows rows;
+        const Basis b = 1 + k * EXPORT_CHUNK;
+        CollectRows(blocks, b, min(b + EXPORT_CHUNK, dim), rows);
+
+        const int64_t p = product_base[k], np = rows.left.size();
+        const int64_t t = term_base[k], nt = rows.terms.size();
+        vector<int32_t> basis(nt);
+        vector<uint8_t> coef(nt);
+        for (int64_t i = 0; i < nt; i++) {
+            basis[i] = rows.terms[i].first;
+            coef[i] = rows.terms[i].second;
+        }
+        rows.first.pop_back();
+        for (int64_t i = 0; i < np; i++)
+            rows.first[i] += t;
+
+        const bool ok =
+            pwrite(fd, rows.left.data(), 4 * np, h.offset[0] + 4 * p) == 4 * np &&
+            pwrite(fd, rows.right.data(), 4 * np, h.offset[1] + 4 * p) == 4 * np &&
+            pwrite(fd, rows.first.data(), 8 * np, h.offset[2] + 8 * p) == 8 * np &&
+            pwrite(fd, basis.data(), 4 * nt, h.offset[3] + 4 * t) == 4 * nt &&
+            pwrite(fd, coef.data(), nt, h.offset[4] + t) == nt;
+        if (!ok) {
+#pragma omp critical(export_status)
+            status = 0;
+        }
+    }
+
+    if (close(fd) != 0)
+        status = 0;
+    if (status != OK) {
+        printf("Unable to write file, %s.\n", File);
+        return(0);
+    }
+
+    *Products = h.products;
+    *Terms = h.terms;
+    return(OK);
+}
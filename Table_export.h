@@ -0,0 +1,21 @@
+#ifndef _TABLE_EXPORT_H_
+#define _TABLE_EXPORT_H_
+
+/*******************************************************************/
+/***  FILE :        Table_export.h                               ***/
+/*******************************************************************/
+
+#include <stdio.h>
+
+/* Formats of the multiplication table. */
+#define EXPORT_TEXT         0   /* As view m prints it. */
+#define EXPORT_CSV          1   /* left,right,basis,coef rows. */
+#define EXPORT_COLUMNS      2   /* Binary columns, see Table_export.cpp. */
+
+#define EXPORT_MAGIC        "ALBMTCOL"
+#define EXPORT_VERSION      1
+
+int WriteMultTable(FILE *filePtr, int Format);
+int ExportMultTable(const char *File, int Format);
+
+#endif
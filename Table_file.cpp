@@ -0,0 +1,742 @@
+/*******************************************************************/
+/***  FILE :        Table_file.c                                 ***/
+/***  PUBLIC ROUTINES:                                           ***/
+/***      int SaveTables()                                       ***/
+/***      int LoadTables()                                       ***/
+/***      int LoadTablesToDegree()                               ***/
+/***      void CanonicalIdentities()                             ***/
+/***  PRIVATE ROUTINES:                                          ***/
+/***      void WordString()                                      ***/
+/***      int CheckHeader()                                      ***/
+/***      int CheckTags()                                        ***/
+/***      int CheckTables()                                      ***/
+/***      const char *MapTables()                                ***/
+/***      void EnterTables()                                     ***/
+/***      void RestoreTables()                                   ***/
+/***      void PrintProblemType()                                ***/
+/***  MODULE DESCRIPTION:                                        ***/
+/***      This module writes the Type, Basis and Multiplication  ***/
+/***      tables to a binary file and maps them back in, in      ***/
+/***      place of a build.  The file is tagged with the         ***/
+/***      identities, field and problem type it was built with,  ***/
+/***      and is only loaded into a configuration that has the   ***/
+/***      same ones.  Tables may be saved through a degree below ***/
+/***      the target's; they are then tagged with the target cut ***/
+/***      down to that degree, which is all they depend on, and  ***/
+/***      can be loaded to build on.                             ***/
+/***      The arenas of the Multiplication table are used where  ***/
+/***      they lie in the mapped file, so loading costs about    ***/
+/***      the size of the Basis table and the pages are shared   ***/
+/***      by all processes that map the file.                    ***/
+/*******************************************************************/
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Table_file.h"
+#include "Basis_table.h"
+#include "Build_defs.h"
+#include "driver.h"
+#include "Id_routines.h"
+#include "Mult_table.h"
+#include "Po_parse_exptext.h"
+#include "Type_table.h"
+
+using namespace std;
+
+/*
+ * The file is a File_header followed by its sections, each at an offset
+ * that is a multiple of 8, in the byte order and layout of the machine
+ * that wrote it.  TABLE_FILE_VERSION, in Table_file.h, changes
+ * whenever the layout of a section does.
+ */
+#define TABLE_FILE_MAGIC    "ALBTABLE"
+#define TABLE_FILE_ORDER    0x01020304u
+
+enum {
+    SEC_IDENTITIES,             /* CanonicalIdentities(). */
+    SEC_TYPES,                  /* TT_node per type name. */
+    SEC_BASES,                  /* Saved_basis from basis 1 on. */
+    SEC_BLOCKS,                 /* Saved_block per block. */
+    SEC_COEFS,                  /* The arenas of Mult_table.h. */
+    SEC_OFFSETS,
+    SEC_ROWS,
+    SEC_WORDS,
+    NUM_SECTIONS
+};
+
+struct File_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t basis_size;
+    uint32_t word_size;
+    int32_t field;
+    int32_t degree;             /* The tables are complete through it. */
+    Packed_type target;         /* Cut down to degree. */
+    int64_t count[NUM_SECTIONS];
+    int64_t offset[NUM_SECTIONS];
+};
+
+struct Saved_basis {
+    int32_t left_factor;
+    int32_t right_factor;
+    int32_t type;
+};
+
+struct Saved_block {
+    int32_t left_type;
+    int32_t right_type;
+    int32_t left_begin;
+    int32_t right_begin;
+    int32_t rows;
+    int32_t cols;
+    int32_t result_begin;
+    int32_t wide;
+    int64_t filled;
+    int64_t term_begin;
+    int64_t row_begin;
+    int64_t word_begin;
+    int64_t shift;
+};
+
+static const size_t Section_size[NUM_SECTIONS] = {
+    1, sizeof(TT_node), sizeof(Saved_basis), sizeof(Saved_block),
+    sizeof(Scalar), sizeof(uint16_t), sizeof(unsigned), sizeof(Mt_word)
+};
+
+/* Orders the types of a file, to look them up by value. */
+struct Packed_less {
+    bool operator()(const Packed_type &T1, const Packed_type &T2) const
+    {
+        return(lexicographical_compare(T1.w, T1.w + PACKED_TYPE_WORDS, T2.w, T2.w + PACKED_TYPE_WORDS));
+    }
+};
+
+static void WordString(const term_node *W, bool Top, string &Str);
+static int CheckHeader(const File_header &H, size_t Len, const char *File, bool Verbose);
+static int CheckTags(const File_header &H, const char *Ids, const list<id_queue_node> &Id_queue,
+                     const Packed_type &Target, int Degree, bool Verbose);
+static int CheckTables(const File_header &H, const char *Map, int Degree);
+static const char *MapTables(const char *File, const list<id_queue_node> &Id_queue, const Packed_type &Target,
+                             int Degree, bool Verbose, size_t *Len);
+static void EnterTables(const char *Map, size_t Len, int Degree);
+static void RestoreTables(const File_header &H, const char *Map, int Degree);
+static void PrintProblemType(const Packed_type &T);
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     File -- to write; it is written as File.<host>.<pid> and    */
+/*             then renamed, so a reader never maps a part file.   */
+/*     Id_queue -- the identities the tables were built with.      */
+/*     Degree -- the tables are complete through it.               */
+/* RETURNS:                                                        */
+/*     1 if successfull.                                           */
+/*     0 otherwise.                                                */
+/*******************************************************************/
+int SaveTables(const char *File, const list<id_queue_node> &Id_queue, int Degree)
+{
+    File_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TABLE_FILE_MAGIC, sizeof(h.magic));
+    h.version = TABLE_FILE_VERSION;
+    h.byte_order = TABLE_FILE_ORDER;
+    h.basis_size = sizeof(Basis);
+    h.word_size = sizeof(Mt_word);
+    h.field = GetField();
+    h.degree = Degree;
+    h.target = ClampType(GetTargetType(), Degree);
+
+    string ids;
+    CanonicalIdentities(Id_queue, ids);
+
+    vector<TT_node> types(GetTypeCount());
+    for (Name n = 0; n < (Name) types.size(); n++) {
+        types[n].begin_basis = BeginBasis(n);
+        types[n].end_basis = EndBasis(n);
+        types[n].type = NameToType(n);
+    }
+
+    vector<Saved_basis> bases;
+    for (Basis b = 1; b < GetNextBasisTobeFilled(); b++) {
+        Saved_basis sb = {LeftFactor(b), RightFactor(b), GetType(b)};
+        bases.push_back(sb);
+    }
+
+    vector<Saved_block> blocks;
+    map<pair<Name, Name>, Mt_block>::const_iterator bi;
+    for (bi = mult_table.begin(); bi != mult_table.end(); bi++) {
+        const Mt_block &blk = bi->second;
+        Saved_block sb;
+        memset(&sb, 0, sizeof(sb));
+        sb.left_type = bi->first.first;
+        sb.right_type = bi->first.second;
+        sb.left_begin = blk.left_begin;
+        sb.right_begin = blk.right_begin;
+        sb.rows = blk.rows;
+        sb.cols = blk.cols;
+        sb.filled = blk.filled;
+        sb.term_begin = blk.term_begin;
+        sb.result_begin = blk.result_begin;
+        sb.row_begin = blk.row_begin;
+        sb.word_begin = blk.word_begin;
+        sb.shift = blk.shift;
+        sb.wide = blk.wide;
+        blocks.push_back(sb);
+    }
+
+    long arenas[4];
+    GetMultTableArenas(&arenas[0], &arenas[1], &arenas[2], &arenas[3]);
+
+    const void *data[NUM_SECTIONS] = {
+        ids.data(), types.data(), bases.data(), blocks.data(),
+        Mt_coefs, Mt_offsets, Mt_rows, Mt_words
+    };
+    h.count[SEC_IDENTITIES] = ids.size();
+    h.count[SEC_TYPES] = types.size();
+    h.count[SEC_BASES] = bases.size();
+    h.count[SEC_BLOCKS] = blocks.size();
+    for (int i = 0; i < 4; i++)
+        h.count[SEC_COEFS + i] = arenas[i];
+
+    int64_t pos = sizeof(h);
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        pos = (pos + 7) & ~7;
+        h.offset[i] = pos;
+        pos += h.count[i] * Section_size[i];
+    }
+
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    char tmp[FILENAME_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%s.%d", File, host, (int) getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        printf("Unable to open file, %s.\n", tmp);
+        return(0);
+    }
+
+    const char zeros[8] = {0};
+    fwrite(&h, sizeof(h), 1, fp);
+    pos = sizeof(h);
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        fwrite(zeros, 1, h.offset[i] - pos, fp);
+        fwrite(data[i], Section_size[i], h.count[i], fp);
+        pos = h.offset[i] + h.count[i] * Section_size[i];
+    }
+
+    const bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed || rename(tmp, File) != 0) {
+        printf("Unable to write file, %s.\n", File);
+        remove(tmp);
+        return(0);
+    }
+
+    return(OK);
+}
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     File -- written by SaveTables() through the degree of       */
+/*             Target_type.                                        */
+/*     Id_queue, Target_type -- the current configuration.         */
+/*     Resident -- a Multiplication table is present.              */
+/* RETURNS:                                                        */
+/*     1 if the tables are loaded.                                 */
+/*     0 otherwise, with the tables left as they were.             */
+/* FUNCTION:                                                       */
+/*     Check File in full, then destroy the resident tables and    */
+/*     create the Type table of Target_type to load the tables     */
+/*     into, leaving the arenas where they are mapped.             */
+/*******************************************************************/
+int LoadTables(const char *File, const list<id_queue_node> &Id_queue, Type Target_type, bool Resident)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    int len = 0;
+    while (Target_type[len] != 0)
+        len++;
+    if (len > PACKED_TYPE_LETTERS) {
+        printf("Too many generators for a packed type.\n");
+        return(0);
+    }
+    const Packed_type target = PackType(Target_type, len);
+
+    size_t map_len;
+    const char *map = MapTables(File, Id_queue, target, GetDegree(target), true, &map_len);
+    if (map == NULL)
+        return(0);
+
+    DestroyTypeTable();
+    DestroyMultTable();
+    if (Resident)
+        printf("Destroyed the Multiplication Table.\n");
+    CreateTypeTable(Target_type);
+    CreateBasisTable();
+    EnterTables(map, map_len, GetDegree(target));
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Loaded the tables, %d basis elements, from %s in %.1f ms.\n",
+           GetNextBasisTobeFilled() - 1, File,
+           (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    return(OK);
+}
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     File -- written by SaveTables() through Degree.             */
+/*     Id_queue -- the current identities.                         */
+/*     The Type table created for the current target, the Basis    */
+/*     and Multiplication tables empty.                            */
+/*     Verbose -- say why File does not load.                      */
+/* RETURNS:                                                        */
+/*     1 if the tables through Degree are loaded.                  */
+/*     0 otherwise, with the tables left as they were.             */
+/* FUNCTION:                                                       */
+/*     Map File read only and check it is whole and was built with */
+/*     the current configuration.  The Type table takes the basis ranges of    */
+/*     the types through Degree, matched by value, and the Basis   */
+/*     table and the blocks of the Multiplication table are        */
+/*     entered.  Tables through the target's degree keep their     */
+/*     arenas where they are mapped; tables to be built on have    */
+/*     them copied.                                                */
+/*******************************************************************/
+int LoadTablesToDegree(const char *File, const list<id_queue_node> &Id_queue, int Degree, bool Verbose)
+{
+    size_t len;
+    const char *map = MapTables(File, Id_queue, GetTargetType(), Degree, Verbose, &len);
+    if (map == NULL)
+        return(0);
+
+    EnterTables(map, len, Degree);
+    return(OK);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Ids -- the identities of Id_queue as the tables depend on   */
+/*            them: each is its expanded terms, "coef word", in    */
+/*            ascending order joined by " + ", and the identities, */
+/*            each ended by a 0, follow in ascending order with    */
+/*            repeats dropped.  So neither the order in which they */
+/*            were entered, their spacing, nor the names of the    */
+/*            ".albert" file matter.                               */
+/*******************************************************************/
+void CanonicalIdentities(const list<id_queue_node> &Id_queue, string &Ids)
+{
+    vector<string> identities;
+
+    list<id_queue_node>::const_iterator ii;
+    for (ii = Id_queue.begin(); ii != Id_queue.end(); ii++) {
+        vector<string> terms;
+        for (const term_head *t = ii->identity->terms; t != NULL; t = t->next) {
+            char coef[16];
+            snprintf(coef, sizeof(coef), "%d ", t->coef);
+            string term = coef;
+            WordString(t->term, true, term);
+            terms.push_back(term);
+        }
+        sort(terms.begin(), terms.end());
+
+        string id;
+        for (int k = 0; k < (int) terms.size(); k++)
+            id += (k > 0 ? " + " : "") + terms[k];
+        identities.push_back(id);
+    }
+    sort(identities.begin(), identities.end());
+    identities.erase(unique(identities.begin(), identities.end()), identities.end());
+
+    Ids.clear();
+    for (int k = 0; k < (int) identities.size(); k++) {
+        Ids += identities[k];
+        Ids += '\0';
+    }
+}
+
+
+/* The word W, parenthesized below the top. */
+void WordString(const term_node *W, bool Top, string &Str)
+{
+    if (W->left == NULL) {
+        Str += W->letter;
+        return;
+    }
+    if (!Top)
+        Str += '(';
+    WordString(W->left, false, Str);
+    WordString(W->right, false, Str);
+    if (!Top)
+        Str += ')';
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     1 if H is the header of a table file of this version and    */
+/*       layout whose sections lie within its Len bytes.           */
+/*     0 otherwise.                                                */
+/*******************************************************************/
+int CheckHeader(const File_header &H, size_t Len, const char *File, bool Verbose)
+{
+    if (memcmp(H.magic, TABLE_FILE_MAGIC, sizeof(H.magic)) != 0) {
+        if (Verbose)
+            printf("%s is not a table file.\n", File);
+        return(0);
+    }
+    if (H.version != TABLE_FILE_VERSION || H.byte_order != TABLE_FILE_ORDER ||
+        H.basis_size != sizeof(Basis) || H.word_size != sizeof(Mt_word)) {
+        if (Verbose)
+            printf("%s was written by another version of Albert or on another machine.\n", File);
+        return(0);
+    }
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        if (H.count[i] < 0 || (uint64_t) H.count[i] > Len / Section_size[i] ||
+            H.offset[i] < (int64_t) sizeof(H) || H.offset[i] % 8 != 0 ||
+            (uint64_t) H.offset[i] > Len - H.count[i] * Section_size[i]) {
+            if (Verbose)
+                printf("%s is truncated or damaged.\n", File);
+            return(0);
+        }
+    }
+
+    return(OK);
+}
+
+
+/*******************************************************************/
+/* RETURNS:                                                        */
+/*     1 if the tables of H were built over the current field,     */
+/*       through Degree of the target type Target, with the        */
+/*       identities of Id_queue.                                   */
+/*     0 otherwise, each difference and the refusal printed if     */
+/*       Verbose.                                                  */
+/*******************************************************************/
+int CheckTags(const File_header &H, const char *Ids, const list<id_queue_node> &Id_queue,
+              const Packed_type &Target, int Degree, bool Verbose)
+{
+    int status = OK;
+
+    if (H.field != GetField()) {
+        if (Verbose)
+            printf("Tables were built over Z(%d), not Z(%d).\n", H.field, GetField());
+        status = 0;
+    }
+
+    const Packed_type target = ClampType(Target, Degree);
+    if (H.degree != Degree || memcmp(&H.target, &target, sizeof(target)) != 0) {
+        if (Verbose) {
+            printf("Tables were built for problem type [");
+            PrintProblemType(H.target);
+            if (H.degree != GetDegree(H.target))
+                printf("] through degree %d", H.degree);
+            else
+                printf("]");
+            printf(", not [");
+            PrintProblemType(target);
+            printf("].\n");
+        }
+        status = 0;
+    }
+
+    string ids;
+    CanonicalIdentities(Id_queue, ids);
+    if (H.count[SEC_IDENTITIES] != (int64_t) ids.size() || memcmp(Ids, ids.data(), ids.size()) != 0) {
+        if (Verbose) {
+            printf("Tables were built with the identities:\n");
+            int i = 1;
+            const char *end = Ids + H.count[SEC_IDENTITIES];
+            for (const char *id = Ids; id < end; id += strnlen(id, end - id) + 1)
+                printf("  %d. %.*s \n", i++, (int) strnlen(id, end - id), id);
+            if (i == 1)
+                printf("  none.\n");
+        }
+        status = 0;
+    }
+
+    if (status != OK && Verbose)
+        printf("Can't load the tables.\n");
+
+    return(status);
+}
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     H -- checked by CheckHeader() and CheckTags().              */
+/* RETURNS:                                                        */
+/*     1 if every index of the file is in range: the types through */
+/*       Degree are the distinct subtypes of the target with basis */
+/*       ranges that the bases fill, and each block matches the    */
+/*       ranges of its types, with row entries ascending over its  */
+/*       cells and terms in the field, their offsets within the    */
+/*       range of its product type.                                */
+/*     0 otherwise.                                                */
+/* NOTE:                                                           */
+/*     Reads every term of the file, so a damaged file is refused  */
+/*     rather than read out of bounds once its arenas are used.    */
+/*******************************************************************/
+int CheckTables(const File_header &H, const char *Map, int Degree)
+{
+    const TT_node *types = (const TT_node *) (Map + H.offset[SEC_TYPES]);
+    const Saved_basis *bases = (const Saved_basis *) (Map + H.offset[SEC_BASES]);
+    const Saved_block *blocks = (const Saved_block *) (Map + H.offset[SEC_BLOCKS]);
+    const Scalar *coefs = (const Scalar *) (Map + H.offset[SEC_COEFS]);
+    const uint16_t *offsets = (const uint16_t *) (Map + H.offset[SEC_OFFSETS]);
+    const unsigned *rows = (const unsigned *) (Map + H.offset[SEC_ROWS]);
+    const long num_bases = H.count[SEC_BASES];
+
+    /* The subtypes of the target of each degree, a letter at a time. */
+    vector<long> subtypes(Degree + 1, 0);
+    subtypes[0] = 1;
+    for (int i = 0; i < PACKED_TYPE_LETTERS; i++)
+        for (int d = Degree; d >= 1; d--)
+            for (int k = 1; k <= GetLetter(H.target, i) && k <= d; k++)
+                subtypes[d] += subtypes[d - k];
+
+    map<Packed_type, long, Packed_less> index;
+    vector<long> sizes(H.count[SEC_TYPES], -1);     /* -1 past Degree. */
+    for (long s = 0; s < H.count[SEC_TYPES]; s++) {
+        const TT_node &t = types[s];
+        const int d = GetDegree(t.type);
+        if (d < 1 || d > Degree)
+            continue;
+        if (!IsSubtypePacked(t.type, H.target) || !index.insert(make_pair(t.type, s)).second)
+            return(0);
+        if (t.begin_basis == 0 && t.end_basis == 0)
+            sizes[s] = 0;
+        else if (t.begin_basis >= 1 && t.begin_basis <= t.end_basis && t.end_basis <= num_bases)
+            sizes[s] = t.end_basis - t.begin_basis + 1;
+        else
+            return(0);
+        subtypes[d]--;
+    }
+    for (int d = 1; d <= Degree; d++)
+        if (subtypes[d] != 0)
+            return(0);
+
+    /* Each basis lies in the range of its type, which it fills. */
+    vector<long> filled(H.count[SEC_TYPES], 0);
+    for (long i = 0; i < num_bases; i++) {
+        const Saved_basis &sb = bases[i];
+        if (sb.type < 0 || sb.type >= H.count[SEC_TYPES] || sizes[sb.type] <= 0 ||
+            i + 1 < types[sb.type].begin_basis || i + 1 > types[sb.type].end_basis ||
+            sb.left_factor < 0 || sb.left_factor > i || sb.right_factor < 0 || sb.right_factor > i)
+            return(0);
+        filled[sb.type]++;
+    }
+    for (long s = 0; s < H.count[SEC_TYPES]; s++)
+        if (sizes[s] > 0 && filled[s] != sizes[s])
+            return(0);
+
+    for (long i = 0; i < H.count[SEC_BLOCKS]; i++) {
+        const Saved_block &sb = blocks[i];
+        if (sb.left_type < 0 || sb.left_type >= H.count[SEC_TYPES] || sizes[sb.left_type] <= 0 ||
+            sb.right_type < 0 || sb.right_type >= H.count[SEC_TYPES] || sizes[sb.right_type] <= 0)
+            return(0);
+        const TT_node &l = types[sb.left_type];
+        const TT_node &r = types[sb.right_type];
+        map<Packed_type, long, Packed_less>::const_iterator n = index.find(AddType(l.type, r.type));
+        if (n == index.end())
+            return(0);
+        const TT_node &p = types[n->second];
+        const long size = sizes[n->second];
+
+        const long cells = (long) sb.rows * sb.cols;
+        if (sb.left_begin != l.begin_basis || sb.rows != sizes[sb.left_type] ||
+            sb.right_begin != r.begin_basis || sb.cols != sizes[sb.right_type] ||
+            sb.result_begin != p.begin_basis || sb.wide != (p.end_basis - p.begin_basis >= 0x10000) ||
+            sb.filled < 0 || sb.filled > cells ||
+            sb.term_begin < 0 || sb.term_begin > H.count[SEC_COEFS] ||
+            sb.row_begin < 0 || sb.row_begin > H.count[SEC_ROWS] - cells - 1 ||
+            sb.word_begin < 0 || sb.word_begin > H.count[SEC_WORDS] - cells / 64 - 1)
+            return(0);
+
+        /* Row entries ascend from 0 over the filled cells. */
+        const unsigned *row = rows + sb.row_begin;
+        if (row[0] != 0)
+            return(0);
+        for (long c = 0; c < sb.filled; c++)
+            if (row[c + 1] < row[c])
+                return(0);
+        const long terms = row[sb.filled];
+        if (terms == 0)
+            continue;
+        if (terms > H.count[SEC_COEFS] - sb.term_begin)
+            return(0);
+
+        /* The terms, in the field and within the product type. */
+        const int width = sb.wide ? 2 : 1;
+        if (sb.shift < -width * H.count[SEC_COEFS] || sb.shift > H.count[SEC_OFFSETS])
+            return(0);
+        const long first = width * sb.term_begin + sb.shift;
+        if (first < 0 || first > H.count[SEC_OFFSETS] - width * terms)
+            return(0);
+        for (long k = 0; k < terms; k++) {
+            const long off = sb.wide ? (offsets[first + 2 * k] | (long) offsets[first + 2 * k + 1] << 16)
+                                     : offsets[first + k];
+            if (off >= size || coefs[sb.term_begin + k] >= H.field)
+                return(0);
+        }
+    }
+
+    return(OK);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     *Len -- the length of the mapping returned.                 */
+/* RETURNS:                                                        */
+/*     File mapped read only, if it is a whole table file built    */
+/*     with Id_queue and the current field, through Degree of      */
+/*     Target.                                                     */
+/*     NULL otherwise, the reason printed if Verbose.              */
+/*******************************************************************/
+const char *MapTables(const char *File, const list<id_queue_node> &Id_queue, const Packed_type &Target,
+                      int Degree, bool Verbose, size_t *Len)
+{
+    int fd = open(File, O_RDONLY);
+    if (fd < 0) {
+        if (Verbose)
+            printf("Unable to open file, %s.\n", File);
+        return(NULL);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(File_header)) {
+        close(fd);
+        if (Verbose)
+            printf("%s is not a table file.\n", File);
+        return(NULL);
+    }
+    const size_t len = st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        if (Verbose)
+            printf("Unable to map file, %s.\n", File);
+        return(NULL);
+    }
+
+    const char *base = (const char *) map;
+    const File_header &h = *(const File_header *) map;
+    if (!CheckHeader(h, len, File, Verbose) ||
+        !CheckTags(h, base + h.offset[SEC_IDENTITIES], Id_queue, Target, Degree, Verbose)) {
+        munmap(map, len);
+        return(NULL);
+    }
+    if (!CheckTables(h, base, Degree)) {
+        munmap(map, len);
+        if (Verbose)
+            printf("%s is truncated or damaged.\n", File);
+        return(NULL);
+    }
+
+    *Len = len;
+    return(base);
+}
+
+
+/*******************************************************************/
+/* REQUIRES:                                                       */
+/*     Map -- of Len bytes, from MapTables() through Degree.       */
+/*     The Type table created for the target, the Basis and        */
+/*     Multiplication tables empty.                                */
+/* FUNCTION:                                                       */
+/*     Enter the tables of Map.  Through the target's degree the   */
+/*     arenas are used where they lie in Map, which is then the    */
+/*     table's; below it they are copied and Map unmapped.         */
+/*******************************************************************/
+void EnterTables(const char *Map, size_t Len, int Degree)
+{
+    const File_header &h = *(const File_header *) Map;
+    RestoreTables(h, Map, Degree);
+
+    const long sizes[4] = {(long) h.count[SEC_COEFS], (long) h.count[SEC_OFFSETS],
+                           (long) h.count[SEC_ROWS], (long) h.count[SEC_WORDS]};
+    const Scalar *coefs = (const Scalar *) (Map + h.offset[SEC_COEFS]);
+    const uint16_t *offsets = (const uint16_t *) (Map + h.offset[SEC_OFFSETS]);
+    const unsigned *rows = (const unsigned *) (Map + h.offset[SEC_ROWS]);
+    const Mt_word *words = (const Mt_word *) (Map + h.offset[SEC_WORDS]);
+    if (Degree == GetDegree(GetTargetType()))
+        MapMultTable((void *) Map, Len, sizes, coefs, offsets, rows, words);
+    else {
+        CopyMultTable(sizes, coefs, offsets, rows, words);
+        munmap((void *) Map, Len);
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Type table -- basis ranges of the types through Degree.     */
+/*     Basis table -- the bases of the file entered.               */
+/*     mult_table -- the blocks of the file entered.               */
+/* REQUIRES:                                                       */
+/*     H -- checked by CheckTables(), so the types through Degree  */
+/*          of the file are those of the Type table.               */
+/*******************************************************************/
+void RestoreTables(const File_header &H, const char *Map, int Degree)
+{
+    const TT_node *types = (const TT_node *) (Map + H.offset[SEC_TYPES]);
+    const Saved_basis *bases = (const Saved_basis *) (Map + H.offset[SEC_BASES]);
+    const Saved_block *blocks = (const Saved_block *) (Map + H.offset[SEC_BLOCKS]);
+
+    /* Names of the file to names here; the types through Degree are
+     * those of the target cut down to Degree in both. */
+    vector<Name> names(H.count[SEC_TYPES], -1);
+    for (long s = 0; s < H.count[SEC_TYPES]; s++) {
+        const int d = GetDegree(types[s].type);
+        if (d < 1 || d > Degree)
+            continue;
+        names[s] = TypeToName(types[s].type);
+        UpdateTypeTable(names[s], types[s].begin_basis, types[s].end_basis);
+    }
+
+    for (long i = 0; i < H.count[SEC_BASES]; i++)
+        EnterBasis(bases[i].left_factor, bases[i].right_factor, names[bases[i].type]);
+    IndexBasisFactors();
+
+    for (long i = 0; i < H.count[SEC_BLOCKS]; i++) {
+        const Saved_block &sb = blocks[i];
+        Mt_block &blk = mult_table[make_pair(names[sb.left_type], names[sb.right_type])];
+        blk.left_begin = sb.left_begin;
+        blk.right_begin = sb.right_begin;
+        blk.rows = sb.rows;
+        blk.cols = sb.cols;
+        blk.filled = sb.filled;
+        blk.term_begin = sb.term_begin;
+        blk.row_begin = sb.row_begin;
+        blk.word_begin = sb.word_begin;
+        blk.result_begin = sb.result_begin;
+        blk.result_end = EndBasis(TypeToName(AddType(types[sb.left_type].type, types[sb.right_type].type)));
+        blk.wide = sb.wide;
+        blk.shift = sb.shift;
+    }
+}
+
+
+/* As the display command prints it, taking the letters from a on. */
+void PrintProblemType(const Packed_type &T)
+{
+    for (int i = 0; i < PACKED_TYPE_LETTERS && GetLetter(T, i) > 0; i++) {
+        printf("%s", i > 0 ? "," : "");
+        if (GetLetter(T, i) > 1)
+            printf("%d", GetLetter(T, i));
+        printf("%c", 'a' + i);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef _TABLE_FILE_H_
+#define _TABLE_FILE_H_
+
+/*******************************************************************/
+/***  FILE :        Table_file.h                                 ***/
+/*******************************************************************/
+
+#include <list>
+#include <string>
+
+#include "Build_defs.h"
+#include "Id_routines.h"
+
+#define TABLE_FILE_VERSION  5
+
+int SaveTables(const char *File, const std::list<id_queue_node> &Id_queue, int Degree);
+int LoadTables(const char *File, const std::list<id_queue_node> &Id_queue, Type Target_type, bool Resident);
+int LoadTablesToDegree(const char *File, const std::list<id_queue_node> &Id_queue, int Degree, bool Verbose);
+void CanonicalIdentities(const std::list<id_queue_node> &Id_queue, std::string &Ids);
+
+#endif
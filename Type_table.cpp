@@ -6,30 +6,43 @@
 /***      Type Target_type                                       ***/
 /***  PUBLIC ROUTINES:                                           ***/
 /***      int CreateTypeTable()                                  ***/
+/***      int GetTypeCount()                                     ***/
+/***      Packed_type GetTargetType()                            ***/
 /***      Type FirstTypeDegree()                                 ***/
 /***      Type NextTypeSameDegree()                              ***/
 /***      Basis BeginBasis()                                     ***/
 /***      Basis EndBasis()                                       ***/
+/***      long CountBasisPairs()                                 ***/
+/***      int SubtypesOfDegree()                                 ***/
 /***  PRIVATE ROUTINES:                                          ***/
 /***      int FillTypecount()                                    ***/
 /***      int InitTypetable()                                    ***/
 /***      int FillTypetable()                                    ***/
 /***      int InitStoreblocksizes()                              ***/
 /***      int GetIndex()                                         ***/
+/***      void InitLattice()                                     ***/
+/***      void FillLattice()                                     ***/
 /***  MODULE DESCRIPTION:                                        ***/
 /***      This module contains routines dealing with Type table. ***/
 /***      Given the Target_type, generate a Type_table consisting***/
 /***      of all the subtypes of the Target_type. Also generate  ***/
 /***      data structures to map Degree to subtype and subtype   ***/
 /***      to Type_table.                                         ***/
+/***      The subtype lattice lists, for each subtype, its own   ***/
+/***      subtypes by degree together with what is left of it    ***/
+/***      once each is taken away.                               ***/
+/***      Types are held as Packed_type values, so no type is    ***/
+/***      allocated once the table is built.                     ***/
 /***  NOTE:                                                      ***/
-/***      Target_type[] is assumed to end with a 0 in the last   ***/
+/***      Cur_type[] is assumed to end with a 0 in the last      ***/
 /***      position.                                              ***/
 /*******************************************************************/
 
 #include <vector>
+#include <algorithm>
 
 using std::vector;
+using std::sort;
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,22 +57,29 @@ static void InitStoreblocksizes(void);
 static void FillTypecount(int Cur_scan_pos);
 static int InitTypetable(void);
 static int FillTypetable(int Cur_scan_pos, vector<int> &Temp_dttt_index);
-static int GetIndex(const Type Pntr);
-static void PrintType(Type Pntr, FILE *filePtr);
+static int GetIndex(const Packed_type &T);
+static void InitLattice(void);
+static void FillLattice(Name n, int Cur_scan_pos, int Index, vector<Name> &Subtypes);
+static void PrintType(const Packed_type &T, FILE *filePtr);
 #if 0
 static void PrintTypetable(void);
 static void PrintTypetableindex(void);
 #endif
 
-static Type Target_type = 0;                /* Input from higher level module. */
+static Packed_type Target_type;             /* Input from higher level module. */
 static int Target_type_len = 0;             /* Computed from Target_type.      */
 static int Target_type_deg = 0;             /* Computed from Target_type.      */
 static int *Type_count = NULL;              /* Used to fill Type_table.        */
-static TT_node *Type_table = NULL;          /* Heart of the matter.            */
+static vector<TT_node> Type_table;          /* Heart of the matter.            */
 static int *Type_table_index = NULL;        /* Map type to Type_table.         */
 static int Tot_subtypes = 0;                /* Computed from Type_count. Size of Type_table. */
 static int *Deg_to_type_table_index = NULL; /* Map Degree to Type_table.*/
 static vector<int> Store_block_sizes;       /* To find offset into Type_table. */
+static vector<int> Type_degree;             /* Degree of each subtype.         */
+static vector<int> Type_offset;             /* GetIndex() of each subtype.     */
+static vector<int> Lattice_begin;           /* Per subtype and degree, start in Lattice_subtype. */
+static vector<Name> Lattice_subtype;        /* Subtypes of each subtype, by name. */
+static vector<Name> Lattice_complement;     /* Subtype taken away from its type. */
 
 /*******************************************************************/
 /* GLOBALS INITIALIZED:                                            */
@@ -90,13 +110,13 @@ int CreateTypeTable(Type Cur_type)
     while (Cur_type[i++] != 0)
         Target_type_len++;
 
-    Target_type = GetNewType(); 
-    assert_not_null(Target_type);
-
-    for (i=0;i<Target_type_len;i++)
-        Target_type[i] = Cur_type[i];
+    if (Target_type_len > PACKED_TYPE_LETTERS) {
+        printf("Too many generators for a packed type.\n");
+        return(0);
+    }
 
-    Target_type_deg = GetDegree(Target_type); 
+    Target_type = PackType(Cur_type, Target_type_len);
+    Target_type_deg = GetDegree(Target_type);
 
     InitStoreblocksizes();
 
@@ -111,6 +131,8 @@ int CreateTypeTable(Type Cur_type)
     if (InitTypetable() != OK)
         return(0);
 
+    InitLattice();
+
     if(Type_count) {
       free(Type_count);
       Type_count = NULL;
@@ -125,67 +147,39 @@ int GetTargetLen(void)
 }
 
 
-Type GetNewType(void)
+/* Names run from 0 to GetTypeCount() - 1. */
+int GetTypeCount(void)
 {
-    Type temp_type;
-    int i;
-
-    temp_type = (Type) (Mymalloc((Target_type_len + 1) * sizeof(Degree))); 
-    assert_not_null(temp_type);
-
-    for (i=0;i<=Target_type_len;i++)
-        temp_type[i] = 0;
-
-    return(temp_type);
+    return(Tot_subtypes);
 }
 
 
-void NameToType(Name N, Type T)
+Packed_type GetTargetType(void)
 {
-    assert_not_null_nv(T);
-
-    for (int i=0;i<Target_type_len;i++)
-        T[i] = Type_table[N].type[i];
+    return(Target_type);
 }
 
 
-void SubtractTypeName(Name n1, Name n2, Name *res_name)
+Packed_type NameToType(Name N)
 {
-    Type temp_type;
-    int i;
-
-    temp_type = GetNewType();
-    assert_not_null_nv(temp_type);
-
-    for (i=0;i<Target_type_len;i++)
-        temp_type[i] = Type_table[n1].type[i] - Type_table[n2].type[i];
-
-    *res_name = TypeToName(temp_type);
-
-    free(temp_type);
+    return(Type_table[N].type);
 }
 
 
-int GetDegree(Type Pntr)
+/* n2 must be a subtype of n1.  GetIndex() is linear in the type. */
+void SubtractTypeName(Name n1, Name n2, Name *res_name)
 {
-    int i, deg = 0;
-
-    assert_not_null(Pntr);
-    
-    for (i=0;i<Target_type_len;i++)
-        deg += Pntr[i];
-
-    return(deg);
+    *res_name = Type_table_index[Type_offset[n1] - Type_offset[n2]];
 }
 
 
 int GetDegreeName(Name n)
 {
-    return(GetDegree(Type_table[n].type));
+    return(Type_degree[n]);
 }
 
 
-Name TypeToName(const Type T)
+Name TypeToName(const Packed_type &T)
 {
     return(Type_table_index[GetIndex(T)]);
 }
@@ -193,11 +187,7 @@ Name TypeToName(const Type T)
 
 bool IsSubtype(Name n1, Name n2)
 {
-    for (int i=0; i<Target_type_len; i++)
-        if (Type_table[n1].type[i] > Type_table[n2].type[i])
-          return false;
-
-    return true;
+    return(IsSubtypePacked(Type_table[n1].type, Type_table[n2].type));
 }
 
 
@@ -236,7 +226,7 @@ void InitStoreblocksizes(void)
 
     Store_block_sizes[Target_type_len - 1] = 1;
     for (int i=Target_type_len - 2; i>=0; i--) {
-        Store_block_sizes[i] = (Target_type[i+1] + 1) * Store_block_sizes[i+1]; 
+        Store_block_sizes[i] = (GetLetter(Target_type, i+1) + 1) * Store_block_sizes[i+1];
     }
 }
 
@@ -257,19 +247,15 @@ void InitStoreblocksizes(void)
 /*******************************************************************/ 
 void FillTypecount(int Cur_scan_pos)
 {
-    if (Cur_scan_pos > Target_type_len) {    
-        int d = 0;
-        for (int i=0; i<Target_type_len; i++) {
-            d += Target_type[i];
-        }
-        Type_count[d]++;
+    if (Cur_scan_pos == Target_type_len) {
+        Type_count[GetDegree(Target_type)]++;
     } else {
-        for (int i=0;i<=Target_type[Cur_scan_pos];i++) {
-            int save = Target_type[Cur_scan_pos];
-            Target_type[Cur_scan_pos] = i;
+        Degree save = GetLetter(Target_type, Cur_scan_pos);
+        for (int i=0;i<=save;i++) {
+            SetLetter(Target_type, Cur_scan_pos, i);
             FillTypecount(Cur_scan_pos + 1);
-            Target_type[Cur_scan_pos] = save;
         }
+        SetLetter(Target_type, Cur_scan_pos, save);
     }
 }
 
@@ -299,12 +285,10 @@ int InitTypetable(void)
     for (i=0;i<=Target_type_deg;i++)
         Tot_subtypes += Type_count[i];
 
-    Type_table = (TT_node *) Mymalloc(Tot_subtypes * sizeof(TT_node));
-    assert_not_null(Type_table);
+    Type_table.resize(Tot_subtypes);
 
     for (i=0;i<Tot_subtypes;i++) {
-        Type_table[i].type = GetNewType(); 
-        assert_not_null(Type_table[i].type);
+        Type_table[i].type = ZeroType();
         Type_table[i].begin_basis = Type_table[i].end_basis = 0;
     }
    
@@ -332,14 +316,7 @@ int InitTypetable(void)
 
 void DestroyTypeTable(void)
 {
-    if(Type_table) {
-      for(int i=0;i<Tot_subtypes;i++) {
-        if(Type_table[i].type) free(Type_table[i].type);
-      }
-
-      free(Type_table);
-      Type_table = NULL;
-    }
+    Type_table.clear();
 
     if(Deg_to_type_table_index) {
       free(Deg_to_type_table_index);
@@ -352,6 +329,106 @@ void DestroyTypeTable(void)
     }
 
     Store_block_sizes.clear();
+    Type_degree.clear();
+    Type_offset.clear();
+    Lattice_begin.clear();
+    Lattice_subtype.clear();
+    Lattice_complement.clear();
+}
+
+
+/*******************************************************************/
+/* GLOBALS INITIALIZED:                                            */
+/*     Type_degree[], Type_offset[] -- Degree and index of each    */
+/*         subtype.                                                */
+/*     Lattice_subtype[] -- The subtypes of each subtype in turn,  */
+/*         in ascending name, hence ascending Degree.              */
+/*     Lattice_complement[] -- For each entry of Lattice_subtype[] */
+/*         the type less that subtype.                             */
+/*     Lattice_begin[] -- Where the subtypes of Degree d of n      */
+/*         begin, at n*(Target_type_deg + 2) + d.                  */
+/* REQUIRES:                                                       */
+/*     Type_table[], Type_table_index[] filled.                    */
+/*******************************************************************/
+void InitLattice(void)
+{
+    const int width = Target_type_deg + 2;
+    long total = 0;
+
+    Type_degree.resize(Tot_subtypes);
+    Type_offset.resize(Tot_subtypes);
+    for (Name n=0; n<Tot_subtypes; n++) {
+        Type_degree[n] = GetDegree(Type_table[n].type);
+        Type_offset[n] = GetIndex(Type_table[n].type);
+        long count = 1;
+        for (int i=0; i<Target_type_len; i++)
+            count *= GetLetter(Type_table[n].type, i) + 1;
+        total += count;
+    }
+
+    Lattice_begin.resize((long) Tot_subtypes * width);
+    Lattice_subtype.clear();
+    Lattice_subtype.reserve(total);
+    Lattice_complement.clear();
+    Lattice_complement.reserve(total);
+
+    vector<Name> subtypes;
+    for (Name n=0; n<Tot_subtypes; n++) {
+        subtypes.clear();
+        FillLattice(n, 0, 0, subtypes);
+        sort(subtypes.begin(), subtypes.end());
+
+        int d = 0;
+        for (int k=0; k<(int)subtypes.size(); k++) {
+            while (d <= Type_degree[subtypes[k]])
+                Lattice_begin[n*width + d++] = Lattice_subtype.size();
+            Lattice_subtype.push_back(subtypes[k]);
+            Lattice_complement.push_back(Type_table_index[Type_offset[n] - Type_offset[subtypes[k]]]);
+        }
+        while (d < width)
+            Lattice_begin[n*width + d++] = Lattice_subtype.size();
+    }
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Subtypes -- gets every subtype of n agreeing with the       */
+/*         letters before Cur_scan_pos whose GetIndex() so far is  */
+/*         Index.                                                  */
+/*******************************************************************/
+void FillLattice(Name n, int Cur_scan_pos, int Index, vector<Name> &Subtypes)
+{
+    if (Cur_scan_pos == Target_type_len) {
+        Subtypes.push_back(Type_table_index[Index]);
+        return;
+    }
+
+    for (int i=0;i<=GetLetter(Type_table[n].type, Cur_scan_pos);i++)
+        FillLattice(n, Cur_scan_pos + 1, Index + i * Store_block_sizes[Cur_scan_pos], Subtypes);
+}
+
+
+/*******************************************************************/
+/* MODIFIES:                                                       */
+/*     Subtypes -- the subtypes of n of Degree D, ascending.       */
+/*     Complements -- n less each of them, entry for entry.        */
+/* RETURNS:                                                        */
+/*     The number of such subtypes.                                */
+/*******************************************************************/
+int SubtypesOfDegree(Name n, int D, const Name **Subtypes, const Name **Complements)
+{
+    const int *begin = &Lattice_begin[n * (Target_type_deg + 2)];
+
+    if ((D < 0) || (D > Type_degree[n])) {
+        *Subtypes = *Complements = NULL;
+        return(0);
+    }
+
+    *Subtypes = &Lattice_subtype[begin[D]];
+    *Complements = &Lattice_complement[begin[D]];
+
+    return(begin[D+1] - begin[D]);
 }
 
 
@@ -374,23 +451,20 @@ void DestroyTypeTable(void)
 /*******************************************************************/ 
 int FillTypetable(int Cur_scan_pos, vector<int> &Temp_dttt_index)
 {
-    if (Cur_scan_pos > Target_type_len) {    
-        int d = 0;
-        for (int i=0;i<Target_type_len;i++)
-            d += Target_type[i];
+    if (Cur_scan_pos == Target_type_len) {
+        int d = GetDegree(Target_type);
 
-        for (int i=0;i<=Target_type_len;i++)
-            Type_table[Temp_dttt_index[d]].type[i] = Target_type[i];
+        Type_table[Temp_dttt_index[d]].type = Target_type;
 
         Type_table_index[GetIndex(Target_type)] = Temp_dttt_index[d];
         Temp_dttt_index[d]++;
     } else {
-        for (int i=0;i<=Target_type[Cur_scan_pos];i++) {
-            int save = Target_type[Cur_scan_pos];
-            Target_type[Cur_scan_pos] = i;
+        Degree save = GetLetter(Target_type, Cur_scan_pos);
+        for (int i=0;i<=save;i++) {
+            SetLetter(Target_type, Cur_scan_pos, i);
             FillTypetable(Cur_scan_pos + 1, Temp_dttt_index);
-            Target_type[Cur_scan_pos] = save;
         }
+        SetLetter(Target_type, Cur_scan_pos, save);
     }
     return(OK);
 }
@@ -403,16 +477,15 @@ int FillTypetable(int Cur_scan_pos, vector<int> &Temp_dttt_index)
 /* REQUIRES:                                                       */
 /*     Type for which index into Type_table[] is to be found.      */
 /* RETURNS:                                                        */
-/*     Index into the Type_table.                                  */
+/*     Index into the Type_table: the mixed radix dot product of   */
+/*     the letters with Store_block_sizes[].                       */
 /*******************************************************************/ 
-int GetIndex(const Type Pntr)
+int GetIndex(const Packed_type &T)
 {
-    assert_not_null(Pntr);
-
     int result = 0;
 
     for (int i=0;i<Target_type_len;i++) 
-        result += Pntr[i] * Store_block_sizes[i];
+        result += GetLetter(T, i) * Store_block_sizes[i];
 
     return(result);
 }
@@ -498,14 +571,38 @@ Basis EndBasis(Name n)
     return(Type_table[n].end_basis);
 }
 
-void PrintType(Type Pntr, FILE *filePtr)
+
+/*******************************************************************/
+/* MODIFIES: None.                                                 */
+/* REQUIRES:                                                       */
+/*     n -- a type whose proper subtypes all have their basis.     */
+/* RETURNS:                                                        */
+/*     Number of basis pairs (l, r) whose types add up to n.       */
+/*******************************************************************/
+long CountBasisPairs(Name n)
 {
-    int i;
+    long count = 0;
+    const int d = GetDegreeName(n);
+
+    for (int i=1; i<d; i++) {
+        const Name *subtypes, *complements;
+        int num = SubtypesOfDegree(n, i, &subtypes, &complements);
+        for (int k=0; k<num; k++) {
+            Name t = subtypes[k];
+            Name c = complements[k];
+            if (BeginBasis(t) == 0 || BeginBasis(c) == 0)
+                continue;
+            count += (long)(EndBasis(t) - BeginBasis(t) + 1) * (EndBasis(c) - BeginBasis(c) + 1);
+        }
+    }
 
-    assert_not_null_nv(Pntr);
+    return(count);
+}
 
-    for (i=0;i<Target_type_len;i++)
-        fprintf(filePtr, "%d",Pntr[i]);
+void PrintType(const Packed_type &T, FILE *filePtr)
+{
+    for (int i=0;i<Target_type_len;i++)
+        fprintf(filePtr, "%d",GetLetter(T, i));
 }
 
 
@@ -524,7 +621,7 @@ void PrintTypetable(void)
     for (i=0;i<Tot_subtypes;i++) {
         printf("   ");
         for (j=0;j<Target_type_len;j++)
-            printf("%d",Type_table[i].type[j]);
+            printf("%d",GetLetter(Type_table[i].type, j));
         printf(" %3d %3d",Type_table[i].begin_basis,Type_table[i].end_basis);
         printf("\n");
     }
@@ -7,22 +7,114 @@
 /***  DATE WRITTEN: May 1990                                     ***/
 /*******************************************************************/
 
+#include <stdint.h>
+
 #include "Build_defs.h"
 
+/*
+ * A type packed one letter per byte into a fixed 256 bit word, so that
+ * it is held by value and handled a 64 bit word at a time.  Letter
+ * degrees stay below 0x80, which the subtype test relies on.
+ */
+#define PACKED_TYPE_WORDS   4
+#define PACKED_TYPE_LETTERS (8 * PACKED_TYPE_WORDS)
+
+struct Packed_type {
+    uint64_t w[PACKED_TYPE_WORDS];
+};
+
+#define PACKED_LOW_BITS  0x0101010101010101ULL
+#define PACKED_HIGH_BITS 0x8080808080808080ULL
+
+inline Packed_type ZeroType(void)
+{
+    Packed_type t = {{0, 0, 0, 0}};
+    return t;
+}
+
+inline Degree GetLetter(const Packed_type &T, int i)
+{
+    return (Degree) ((T.w[i >> 3] >> ((i & 7) * 8)) & 0xff);
+}
+
+inline void SetLetter(Packed_type &T, int i, Degree d)
+{
+    const int shift = (i & 7) * 8;
+    T.w[i >> 3] = (T.w[i >> 3] & ~(0xffULL << shift)) | ((uint64_t) (unsigned char) d << shift);
+}
+
+/* Len letters of a Type as a Packed_type. */
+inline Packed_type PackType(const Type T, int Len)
+{
+    Packed_type p = ZeroType();
+    for (int i=0; i<Len; i++)
+        SetLetter(p, i, T[i]);
+    return p;
+}
+
+/* The sum stays a type, so no byte carries into the next. */
+inline Packed_type AddType(const Packed_type &T1, const Packed_type &T2)
+{
+    Packed_type s;
+    for (int k=0; k<PACKED_TYPE_WORDS; k++)
+        s.w[k] = T1.w[k] + T2.w[k];
+    return s;
+}
+
+/* T with every letter degree cut down to at most D. */
+inline Packed_type ClampType(const Packed_type &T, int D)
+{
+    Packed_type c = T;
+    for (int i=0; i<PACKED_TYPE_LETTERS; i++)
+        if (GetLetter(c, i) > D)
+            SetLetter(c, i, (Degree) D);
+    return c;
+}
+
+/* Sub must be a subtype of T, so no byte borrows from the next. */
+inline Packed_type SubtractType(const Packed_type &T, const Packed_type &Sub)
+{
+    Packed_type d;
+    for (int k=0; k<PACKED_TYPE_WORDS; k++)
+        d.w[k] = T.w[k] - Sub.w[k];
+    return d;
+}
+
+/* Every byte of (T | 0x80..) - Sub keeps its high bit iff T >= Sub there. */
+inline bool IsSubtypePacked(const Packed_type &Sub, const Packed_type &T)
+{
+    for (int k=0; k<PACKED_TYPE_WORDS; k++)
+        if ((((T.w[k] | PACKED_HIGH_BITS) - Sub.w[k]) & PACKED_HIGH_BITS) != PACKED_HIGH_BITS)
+            return false;
+    return true;
+}
+
+/* Bytes are summed pairwise into 16 bit lanes, then the lanes by a multiply. */
+inline int GetDegree(const Packed_type &T)
+{
+    const uint64_t m = 0x00ff00ff00ff00ffULL;
+    int deg = 0;
+    for (int k=0; k<PACKED_TYPE_WORDS; k++) {
+        uint64_t x = (T.w[k] & m) + ((T.w[k] >> 8) & m);
+        deg += (int) ((x * 0x0001000100010001ULL) >> 48);
+    }
+    return deg;
+}
+
 typedef struct tt_node {
     Basis begin_basis;
     Basis end_basis;            /* indices into Base table. */
-    Type type;
+    Packed_type type;
 } TT_node; 
 
 int CreateTypeTable(Type Cur_type);
 int GetTargetLen(void);
-Type GetNewType(void);
-void NameToType(Name N, Type T);
+int GetTypeCount(void);
+Packed_type GetTargetType(void);
+Packed_type NameToType(Name N);
 void SubtractTypeName(Name n1, Name n2, Name *res_name);
-int GetDegree(Type Pntr);
 int GetDegreeName(Name n);
-Name TypeToName(const Type T);
+Name TypeToName(const Packed_type &T);
 bool IsSubtype(Name n1, Name n2);
 void EnterEndBasis(int TTindex, Basis basis);
 void UpdateTypeTable(Name n, Basis Begin_basis, Basis End_basis);
@@ -34,5 +126,7 @@ Basis FirstBasis(Name N);
 Basis NextBasisSameType(Basis B);
 Basis BeginBasis(Name n);
 Basis EndBasis(Name n);
+long CountBasisPairs(Name n);
+int SubtypesOfDegree(Name n, int D, const Name **Subtypes, const Name **Complements);
 
 #endif
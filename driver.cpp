@@ -40,6 +40,7 @@ using std::list;
 #include "driver.h"
 #include "Basis_table.h"
 #include "Build.h"
+#include "Build_cache.h"
 #include "Build_defs.h"
 #include "Field.h"
 #include "Generators.h"
@@ -51,6 +52,8 @@ using std::list;
 #include "Po_parse_exptext.h"
 #include "Po_routines.h"
 #include "Scalar_arithmetic.h"
+#include "Table_export.h"
+#include "Table_file.h"
 #include "Ty_routines.h"
 #include "Type_table.h"
 #include "Mult_table.h"
@@ -68,6 +71,12 @@ static void sigCatch(int x);
 
 
 Scalar Field = DEFAULT_FIELD;          /* Build_defs.h */
+int Equation_mem_limit = DEFAULT_EQUATION_MEM_LIMIT;   /* MB, Build_defs.h */
+int Online_reduction = 0;              /* reduce equation batches as they come */
+int Concurrent_types = 0;              /* process the types of a degree at once */
+int System_allocator = 0;              /* bypass the pools, Memory_routines.h */
+const char *Cache_dir = NULL;          /* build cache, Build_cache.h */
+long Cache_limit = DEFAULT_CACHE_LIMIT;  /* MB, Build_defs.h */
 
 int sigIntFlag = 0;		/* TW 10/8/93 - flag for Ctrl-C */
 jmp_buf env;
@@ -100,6 +109,7 @@ int main(int argc, char *argv[])
     char c;
 
     int mtable_status = NOT_PRESENT;
+    static int cached_degree = 0;       /* of the table, from the build cache */
     int problem_type_present = FALSE;
     int quit = 0;
 
@@ -114,7 +124,7 @@ int main(int argc, char *argv[])
     /*FILE *fp;*/
 
     dir[0] = '\0';			/* initialize dir */
-    if(argc > 5){
+    if(argc > 13){
       usage();
       exit(-1);
     }
@@ -148,6 +158,50 @@ int main(int argc, char *argv[])
                 printf("%s does not exist.\n", dir);
               }*//* TW - check this in Get_Command() */
               break;
+            case 'm':                     /* equation memory limit in MB */
+	      if(argPos){
+		Equation_mem_limit = atoi(argv[i] + argPos);
+	      }
+	      else if(i + 1 < argc){
+	        ++i;
+		Equation_mem_limit = atoi(argv[i]);
+	      }
+	      if(Equation_mem_limit <= 0){
+	        printf("-m requires a positive number of megabytes.\n");
+	        Equation_mem_limit = DEFAULT_EQUATION_MEM_LIMIT;
+	      }
+              break;
+            case 'o':                     /* online solving */
+	      Online_reduction = 1;
+              break;
+            case 'c':                     /* concurrent types */
+	      Concurrent_types = 1;
+              break;
+            case 's':                     /* system allocator */
+	      System_allocator = 1;
+              break;
+            case 'k':                     /* build cache directory */
+	      if(argPos){
+		Cache_dir = argv[i] + argPos;
+	      }
+	      else if(i + 1 < argc){
+	        ++i;
+		Cache_dir = argv[i];
+	      }
+              break;
+            case 'K':                     /* build cache limit in MB */
+	      if(argPos){
+		Cache_limit = atol(argv[i] + argPos);
+	      }
+	      else if(i + 1 < argc){
+	        ++i;
+		Cache_limit = atol(argv[i]);
+	      }
+	      if(Cache_limit <= 0){
+	        printf("-K requires a positive number of megabytes.\n");
+	        Cache_limit = DEFAULT_CACHE_LIMIT;
+	      }
+              break;
             default:
               printf("%c is an invalid flag type.\n", argv[i][1]);
               usage();
@@ -203,6 +257,7 @@ int main(int argc, char *argv[])
             }
             printf("Command unsuccessfull\n");
         }
+        CheckPools();       /* Overflow in the parallel regions of the last command. */
 
 	if(sigIntFlag){		/* TW 10/5/93 - Ctrl-C check */
 	  printf("We have detected a Ctrl-C.\n");
@@ -383,6 +438,7 @@ int main(int argc, char *argv[])
                      mtable_status = PRESENT;
                  else
                      mtable_status = NOT_PRESENT;
+                 cached_degree = CachedDegree();
 		 if(sigIntFlag){	/* TW 10/5/93 - Ctrl-C check */
 		   sigIntFlag = 0;
 		   DestroyMultTable();
@@ -438,7 +494,11 @@ int main(int argc, char *argv[])
                  else
                      printf("Problem type not specified.\n");
 
-                 if (mtable_status == PRESENT)
+                 if (mtable_status == PRESENT && cached_degree == ptype.tot_degree)
+                     printf("Multiplication table present, from the build cache.");
+                 else if (mtable_status == PRESENT && cached_degree > 0)
+                     printf("Multiplication table present, through degree %d from the build cache.", cached_degree);
+                 else if (mtable_status == PRESENT)
                      printf("Multiplication table present.");
                  else
                      printf("Multiplication table not present.");
@@ -635,8 +695,95 @@ type to show */
 		       printf("Multiplication Table not present.\n");
 		     }
                      break;
+                   case 'a':
+		     if(mtable_status == PRESENT){
+		       for(i = 1; Operand[i] == ' '; i++)
+		         ;
+		       if(Operand[i]){	/* "save a file" */
+		         strncpy(tableFileName, Operand + i, sizeof(tableFileName) - 1);
+		         tableFileName[sizeof(tableFileName) - 1] = '\0';
+		       }
+		       else{
+		         printf("File Name --> ");
+		         fflush(stdout);
+		         fgets(tableFileName,sizeof(tableFileName),stdin);
+		         tableFileName[sizeof(tableFileName) - 1] = '\0';
+		         tableFileName[strlen(tableFileName) - 1] = '\0';
+		         printf("\n");
+		       }
+		       if(!strlen(tableFileName)){
+		         printf("No file name was entered.  Command aborted.\n");
+		         break;
+		       }
+		       if(SaveTables(tableFileName, Id_queue, ptype.tot_degree) == OK)
+		         printf("Tables saved to %s.\n", tableFileName);
+		     }
+		     else{
+		       printf("Multiplication Table not present.\n");
+		     }
+                     break;
+                   case 'c':
+                   case 'n':
+		     if(mtable_status == PRESENT){
+		       for(i = 1; Operand[i] == ' '; i++)
+		         ;
+		       if(Operand[i]){	/* "save c file" */
+		         strncpy(tableFileName, Operand + i, sizeof(tableFileName) - 1);
+		         tableFileName[sizeof(tableFileName) - 1] = '\0';
+		       }
+		       else{
+		         printf("File Name --> ");
+		         fflush(stdout);
+		         fgets(tableFileName,sizeof(tableFileName),stdin);
+		         tableFileName[sizeof(tableFileName) - 1] = '\0';
+		         tableFileName[strlen(tableFileName) - 1] = '\0';
+		         printf("\n");
+		       }
+		       if(!strlen(tableFileName)){
+		         printf("No file name was entered.  Command aborted.\n");
+		         break;
+		       }
+		       ExportMultTable(tableFileName, table == 'c' ? EXPORT_CSV : EXPORT_COLUMNS);
+		     }
+		     else{
+		       printf("Multiplication Table not present.\n");
+		     }
+                     break;
                    default:
-                     printf("Invalid table type.  Specify \"m\" or \"b\".\n");
+                     printf("Invalid table type.  Specify \"m\", \"b\", \"a\", \"c\" or \"n\".\n");
+                 }
+		 break;
+
+/* "load" the tables saved by "save a" in place of a build */
+	    case 'l':
+		 if(!Substr(Command, "load")){
+                   printf("Illegal command.");
+                   break;
+		 }
+                 if (!problem_type_present) {
+                     printf("Problem Type not present.\n");
+                     printf("Can't load the tables.\n");
+                     break;
+                 }
+		 if(strlen(Operand)){
+		   strncpy(tableFileName, Operand, sizeof(tableFileName) - 1);
+		   tableFileName[sizeof(tableFileName) - 1] = '\0';
+		 }
+		 else{
+		   printf("File Name --> ");
+		   fflush(stdout);
+		   fgets(tableFileName,sizeof(tableFileName),stdin);
+		   tableFileName[sizeof(tableFileName) - 1] = '\0';
+		   tableFileName[strlen(tableFileName) - 1] = '\0';
+		   printf("\n");
+		   if(!strlen(tableFileName)){
+		     printf("No file name was entered.  Command aborted.\n");
+		     break;
+		   }
+		 }
+                 if (LoadTables(tableFileName, Id_queue, Target_type, mtable_status == PRESENT) == OK) {
+                     mtable_status = PRESENT;
+                     cached_degree = 0;
                  }
 		 break;
 
@@ -803,7 +950,7 @@ int Compatible(struct polynomial *Poly, struct P_type ptype)
 
 void usage(void)
 {
-    printf("Usage:  albert [-a dirname]\n");
+    printf("Usage:  albert [-a dirname] [-m megabytes] [-o] [-c] [-s] [-k dirname] [-K megabytes]\n");
 }
 
 
@@ -4,6 +4,7 @@ import sys
 
 def usage():
   print 'usage: {0:s} <multiplication table fn> <show coeffs: no/yes> <sought terms lhs> <sought terms rhs> <context before> <context after>'.format(sys.argv[0])
+  print 'The table is as view m prints it, or exported as CSV.'
   exit(1)
 
 if len(sys.argv) != 7:
@@ -29,10 +30,12 @@ else:
 
 f = open(fn)
 
+csv = False
 for i in range(2):
   t = f.readline()
   t = t.rstrip()
-  t = t == 'Multiplication table:'
+  csv = i == 0 and t == 'left,right,basis,coef'
+  t = csv or t == 'Multiplication table:'
   if t:
     break
 if not t:
@@ -102,6 +105,31 @@ def h3():
   h2()
 
  
+def csv_products():
+  global lhs, rhs
+
+  product = None
+  for line in f:
+    left, right, basis, coef = line.rstrip().split(',')
+
+    if (left, right) != product:
+      h3()
+
+      product = (left, right)
+      lhs = '(b{0:s})*(b{1:s})'.format(left, right)
+
+    # A zero product has the single row left,right,0,0.
+    if basis != '0':
+      term = '{0:s} b{1:s}'.format(coef, basis)
+      if rhs != '':
+        rhs += ' + ' + term
+      else:
+        rhs = term
+
+
+if csv:
+  csv_products()
+
 for line in f:
   line = line.rstrip()
   